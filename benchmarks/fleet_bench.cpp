@@ -0,0 +1,90 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2020, Aleksei Dynda
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "sme/fleet.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+// Measures transitions per second of SmFleet: all instances get an event
+// on each step, and the events are applied with scalar and vector code.
+
+enum
+{
+    EVENT_NEXT,
+    EVENT_RESET,
+};
+
+static constexpr int STATES = 16;
+
+#define NEXT_ROW(state) ROW_SIMPLE(state, EVENT_NEXT, nullptr, ((state) + 1) % STATES),
+
+// All transitions go to the dense table, since they have no actions
+static constexpr SmTransitionRow fleetRows[] =
+{
+    NEXT_ROW(0) NEXT_ROW(1) NEXT_ROW(2) NEXT_ROW(3) NEXT_ROW(4) NEXT_ROW(5) NEXT_ROW(6) NEXT_ROW(7)
+    NEXT_ROW(8) NEXT_ROW(9) NEXT_ROW(10) NEXT_ROW(11) NEXT_ROW(12) NEXT_ROW(13) NEXT_ROW(14) NEXT_ROW(15)
+    ROW_SIMPLE(SM_STATE_ANY, EVENT_RESET, nullptr, 0),
+};
+
+static double runFleet(int instances, int steps, bool vectorized)
+{
+    SmFleet<fleetRows> fleet( instances, STATES );
+    fleet.setVectorized( vectorized );
+    fleet.begin( 0 );
+    double seconds = 0;
+    for (int n = 0; n < steps; n++)
+    {
+        for (int i = 0; i < instances; i++)
+        {
+            fleet.sendEvent( i, { static_cast<uint8_t>( (i + n) % 7 == 0 ? EVENT_RESET : EVENT_NEXT ), 0 } );
+        }
+        auto ts = std::chrono::steady_clock::now();
+        fleet.step();
+        seconds += std::chrono::duration<double>( std::chrono::steady_clock::now() - ts ).count();
+    }
+    return static_cast<double>( instances ) * steps / seconds;
+}
+
+int main(int argc, char *argv[])
+{
+    int instances = argc > 1 ? atoi( argv[1] ) : 1000000;
+    int steps = argc > 2 ? atoi( argv[2] ) : 100;
+    printf( "instances: %d, steps: %d, avx2: %s\n", instances, steps, sme::fleetVectorized() ? "yes" : "no" );
+    printf( "scalar: %14.0f transitions/sec\n", runFleet( instances, steps, false ) );
+    if ( sme::fleetVectorized() )
+    {
+        printf( "avx2:   %14.0f transitions/sec\n", runFleet( instances, steps, true ) );
+    }
+    return 0;
+}
@@ -0,0 +1,144 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2020, Aleksei Dynda
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+*/
+
+#include "sme/generic_state.h"
+#include "sme/generic_state_engine.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+// Measures wake-up latency of the engine for each wait strategy: single
+// producer sends timestamped events with a pause between them, so the engine
+// goes idle before each event arrives.
+
+enum
+{
+    EVENT_PING,
+};
+
+enum
+{
+    STATE_IDLE,
+};
+
+static const int BUCKETS = 16;
+
+static ISmEngine *s_engine = nullptr;
+static std::vector<uint64_t> s_latency;
+static int s_expected = 0;
+
+static uint64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+static void onPing(SEventData event)
+{
+    s_latency.push_back( nowNs() - event.arg );
+    if ( static_cast<int>( s_latency.size() ) == s_expected )
+    {
+        s_engine->stop();
+    }
+}
+
+static C_TRANSITION_TBL(idleTable)
+{
+    NO_TRANSITION(EVENT_PING, SM_EVENT_ARG_ANY, onPing( event ))
+    TRANSITION_TBL_END
+}
+
+static void runStrategy(const char *name, EWaitStrategy strategy, int samples, int gapUs)
+{
+    GenericState<sme::NO_ENTER, sme::NO_UPDATE, sme::NO_EXIT, idleTable> idle(STATE_IDLE);
+    SmStateInfo statesList[] =
+    {
+        STATE_LIST_ITEM(idle),
+        STATE_LIST_END,
+    };
+    GenericStateEngine<sme::NO_TABLE> sm(statesList);
+    s_engine = &sm;
+    s_latency.clear();
+    s_latency.reserve( samples );
+    s_expected = samples;
+    sm.setWaitStrategy( strategy );
+    sm.begin(STATE_IDLE);
+
+    std::thread producer([&sm, samples, gapUs]() {
+        for (int n = 0; n < samples; n++)
+        {
+            std::this_thread::sleep_for( std::chrono::microseconds( gapUs ) );
+            sm.sendEvent( { EVENT_PING, static_cast<uintptr_t>( nowNs() ) } );
+        }
+    });
+    sm.loop();
+    producer.join();
+    sm.end();
+
+    // Histogram with power of two buckets in microseconds
+    int histogram[BUCKETS] = {};
+    for (uint64_t ns: s_latency)
+    {
+        int bucket = 0;
+        for (uint64_t us = ns / 1000; us > 0 && bucket < BUCKETS - 1; us >>= 1) bucket++;
+        histogram[bucket]++;
+    }
+    std::sort( s_latency.begin(), s_latency.end() );
+    auto percentile = [](double p) -> double
+    {
+        return s_latency[static_cast<size_t>( p * (s_latency.size() - 1) )] / 1000.0;
+    };
+    printf( "%-10s p50: %8.1f us, p90: %8.1f us, p99: %8.1f us, max: %8.1f us\n", name,
+            percentile( 0.5 ), percentile( 0.9 ), percentile( 0.99 ), percentile( 1.0 ) );
+    for (int i = 0; i < BUCKETS; i++)
+    {
+        if ( histogram[i] == 0 ) continue;
+        if ( i == 0 ) printf( "    %6s < %6d us: %d\n", "", 1, histogram[i] );
+        else printf( "    %6d - %6d us: %d\n", 1 << (i - 1), 1 << i, histogram[i] );
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int samples = argc > 1 ? atoi( argv[1] ) : 2000;
+    int gapUs = argc > 2 ? atoi( argv[2] ) : 200;
+    printf( "samples: %d, pause between events: %d us, cores: %u\n",
+            samples, gapUs, std::thread::hardware_concurrency() );
+    runStrategy( "blocking", EWaitStrategy::BLOCKING, samples, gapUs );
+    runStrategy( "busy-spin", EWaitStrategy::BUSY_SPIN, samples, gapUs );
+    runStrategy( "spin-yield", EWaitStrategy::SPIN_YIELD, samples, gapUs );
+    runStrategy( "spin-park", EWaitStrategy::SPIN_PARK, samples, gapUs );
+    return 0;
+}
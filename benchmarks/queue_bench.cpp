@@ -0,0 +1,139 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2020, Aleksei Dynda
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "sme/generic_state.h"
+#include "sme/generic_state_engine.h"
+#include "sme/event_buffer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <atomic>
+
+// Measures throughput of the engine event queue: N producer threads
+// send events to a single engine running loop() in the main thread.
+
+enum
+{
+    EVENT_DATA,
+};
+
+enum
+{
+    STATE_IDLE,
+};
+
+static const int EVENTS_PER_RUN = 2000000;
+
+static ISmEngine *s_engine = nullptr;
+static int s_received = 0;
+static int s_expected = 0;
+
+static void onData()
+{
+    if ( ++s_received == s_expected )
+    {
+        s_engine->stop();
+    }
+}
+
+static C_TRANSITION_TBL(idleTable)
+{
+    NO_TRANSITION(EVENT_DATA, SM_EVENT_ARG_ANY, onData())
+    TRANSITION_TBL_END
+}
+
+static double runProducers(int producers, int queueSize, int batchSize, bool staged)
+{
+    GenericState<sme::NO_ENTER, sme::NO_UPDATE, sme::NO_EXIT, idleTable> idle(STATE_IDLE);
+    SmStateInfo statesList[] =
+    {
+        STATE_LIST_ITEM(idle),
+        STATE_LIST_END,
+    };
+    GenericStateEngine<sme::NO_TABLE> sm(statesList, queueSize);
+    s_engine = &sm;
+    s_received = 0;
+    s_expected = (EVENTS_PER_RUN / producers) * producers;
+    sm.setMaxBatchSize( batchSize );
+    sm.begin(STATE_IDLE);
+
+    std::atomic<bool> start{false};
+    std::vector<std::thread> threads;
+    for (int i = 0; i < producers; i++)
+    {
+        threads.emplace_back([&sm, &start, producers, staged]() {
+            SmEventBuffer<64> buffer( sm );
+            while ( !start.load() ) std::this_thread::yield();
+            for (int n = 0; n < EVENTS_PER_RUN / producers; n++)
+            {
+                SEventData event = { EVENT_DATA, static_cast<uintptr_t>(n) };
+                while ( !( staged ? buffer.sendEvent( event ) : sm.sendEvent( event ) ) )
+                {
+                    std::this_thread::yield();
+                }
+            }
+            while ( buffer.size() )
+            {
+                if ( !buffer.flush() ) std::this_thread::yield();
+            }
+        });
+    }
+    auto ts = std::chrono::steady_clock::now();
+    start.store( true );
+    sm.loop( 1 );
+    auto te = std::chrono::steady_clock::now();
+    for (auto &t: threads)
+    {
+        t.join();
+    }
+    sm.end();
+    double seconds = std::chrono::duration<double>( te - ts ).count();
+    return s_received / seconds;
+}
+
+int main(int argc, char *argv[])
+{
+    int queueSize = argc > 1 ? atoi( argv[1] ) : 1024;
+    int batchSize = argc > 2 ? atoi( argv[2] ) : 0;
+    bool staged = argc > 3 && atoi( argv[3] ) != 0;
+    printf( "queue size: %d, max batch size: %d, staged producers: %s, events per run: %d\n",
+            queueSize, batchSize, staged ? "yes" : "no", EVENTS_PER_RUN );
+    const int producers[] = { 1, 4, 16 };
+    for (int n: producers)
+    {
+        printf( "%2d producer(s): %12.0f events/sec\n", n, runProducers( n, queueSize, batchSize, staged ) );
+    }
+    return 0;
+}
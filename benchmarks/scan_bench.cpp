@@ -0,0 +1,117 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2020, Aleksei Dynda
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "sme/generic_state.h"
+#include "sme/scan_table.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+// Compares lookup time of macro if-chain tables and scanTable for states with
+// N rows, keyed by sparse (event, arg) pairs. Events hit rows in random order.
+
+static constexpr int EVENTS = 8;
+
+// Event ids are shuffled, so blocks of 32 rows differ
+#define EVENT_OF(n) (((n) * 5 + (n) / 32) % EVENTS)
+
+#define CHAIN_ROW(n) TRANSITION_SWITCH(EVENT_OF(n), (n) * 13u, sme::NO_FUNC, (n) % 3)
+#define SCAN_ROW(n) ROW_SWITCH(SM_STATE_ANY, EVENT_OF(n), (n) * 13u, sme::NO_FUNC, (n) % 3),
+
+#define ROWS4(R, n) R(n) R(n + 1) R(n + 2) R(n + 3)
+#define ROWS8(R, n) ROWS4(R, n) ROWS4(R, n + 4)
+#define ROWS16(R, n) ROWS8(R, n) ROWS8(R, n + 8)
+#define ROWS32(R, n) ROWS16(R, n) ROWS16(R, n + 16)
+#define ROWS64(R, n) ROWS32(R, n) ROWS32(R, n + 32)
+#define ROWS128(R, n) ROWS64(R, n) ROWS64(R, n + 64)
+
+#define BENCH_TABLES(N) \
+    static C_TRANSITION_TBL(chain##N) \
+    { \
+        ROWS##N(CHAIN_ROW, 0) \
+        TRANSITION_TBL_END \
+    } \
+    static constexpr SmTransitionRow rows##N[] = { ROWS##N(SCAN_ROW, 0) };
+
+BENCH_TABLES(8)
+BENCH_TABLES(16)
+BENCH_TABLES(32)
+BENCH_TABLES(64)
+BENCH_TABLES(128)
+
+static const int LOOKUPS = 10000000;
+
+static double run(TSmeTable table, int rows)
+{
+    static SEventData events[4096];
+    srand( 1 );
+    for (auto &event: events)
+    {
+        int n = rand() % rows;
+        event = { static_cast<uint8_t>( EVENT_OF(n) ), n * 13u };
+    }
+    unsigned sum = 0;
+    auto ts = std::chrono::steady_clock::now();
+    for (int i = 0; i < LOOKUPS; i++)
+    {
+        sum += table( 0, events[i % 4096] ).stateId;
+    }
+    double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - ts ).count();
+    if ( sum == 0 )
+    {
+        printf( "unexpected result\n" );
+    }
+    return seconds * 1e9 / LOOKUPS;
+}
+
+int main(int argc, char *argv[])
+{
+    const struct
+    {
+        int rows;
+        TSmeTable chain;
+        TSmeTable scan;
+    } tables[] =
+    {
+        { 8, chain8, sme::scanTable<rows8> },
+        { 16, chain16, sme::scanTable<rows16> },
+        { 32, chain32, sme::scanTable<rows32> },
+        { 64, chain64, sme::scanTable<rows64> },
+        { 128, chain128, sme::scanTable<rows128> },
+    };
+    for (auto &t: tables)
+    {
+        printf( "%3d rows: if-chain %6.1f ns, scan %6.1f ns\n", t.rows, run( t.chain, t.rows ), run( t.scan, t.rows ) );
+    }
+    return 0;
+}
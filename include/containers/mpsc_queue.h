@@ -0,0 +1,456 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2020, Aleksei Dynda
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "../sme/config.h"
+
+#include <stdint.h>
+
+#if SM_ENGINE_MULTITHREAD
+
+#include <atomic>
+#include <thread>
+#include <stddef.h>
+
+namespace sme {
+
+/**
+ * Bounded lock-free ring buffer for many producers and a single consumer.
+ * The ring is allocated for the ceiling capacity, rounded up to the nearest
+ * power of two, while the number of stored elements is limited exactly by
+ * the current capacity. push(), evict() and replace() can be called from any
+ * thread, pop() is called by the single consumer.
+ *
+ * Producers, which evict or replace elements, lock one cell for the time of
+ * copying it. pop() never waits for such cell: it returns false, while empty()
+ * still reports the queue as not empty, so the consumer retries later. This
+ * keeps the consumer wait-free, but a producer, preempted while holding the
+ * cell, delays the consumer until it resumes.
+ */
+template <typename T>
+class mpsc_queue
+{
+public:
+    explicit mpsc_queue(int capacity = 1) { reset( capacity ); }
+
+    ~mpsc_queue()
+    {
+        delete[] m_cells;
+        delete m_pos;
+    }
+
+    /**
+     * Drops all elements and changes the capacity. Not thread-safe, the queue
+     * must not be accessed by other threads during the call.
+     *
+     * @param capacity maximum number of elements in the queue
+     * @param ceiling capacity, the queue can grow() up to
+     */
+    void reset(int capacity, int ceiling = 0)
+    {
+        if ( capacity < 1 ) capacity = 1;
+        if ( ceiling < capacity ) ceiling = capacity;
+        delete[] m_cells;
+        if ( m_pos == nullptr )
+        {
+            m_pos = new positions();
+        }
+        m_mask = roundUp( ceiling ) - 1;
+        m_cells = new cell[m_mask + 1];
+        for (size_t i = 0; i <= m_mask; i++) m_cells[i].seq.store( i, std::memory_order_relaxed );
+        m_pos->head.store( 0, std::memory_order_relaxed );
+        m_pos->tail.store( 0, std::memory_order_relaxed );
+        m_limit.store( capacity, std::memory_order_relaxed );
+        m_ceiling = ceiling;
+    }
+
+    mpsc_queue(const mpsc_queue &) = delete;
+    mpsc_queue &operator=(const mpsc_queue &) = delete;
+
+    bool push( const T &e )
+    {
+        size_t pos = m_pos->head.load( std::memory_order_relaxed );
+        for (;;)
+        {
+            cell &c = m_cells[pos & m_mask];
+            intptr_t diff = static_cast<intptr_t>( c.seq.load( std::memory_order_acquire ) - pos );
+            if ( diff == 0 )
+            {
+                intptr_t room = vacant( pos );
+                if ( room < 0 )
+                {
+                    pos = m_pos->head.load( std::memory_order_relaxed );
+                    continue;
+                }
+                if ( room == 0 )
+                {
+                    return false;
+                }
+                if ( m_pos->head.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) )
+                {
+                    c.data = e;
+                    c.seq.store( pos + 1, std::memory_order_release );
+                    return true;
+                }
+            }
+            else if ( diff < 0 )
+            {
+                return false;
+            }
+            else
+            {
+                pos = m_pos->head.load( std::memory_order_relaxed );
+            }
+        }
+    }
+
+    /**
+     * Pushes up to count elements, claiming free cells with single CAS operation.
+     * Returns number of pushed elements.
+     */
+    int push( const T *e, int count )
+    {
+        size_t pos = m_pos->head.load( std::memory_order_relaxed );
+        int n;
+        for (;;)
+        {
+            intptr_t limit = vacant( pos );
+            if ( limit < 0 )
+            {
+                pos = m_pos->head.load( std::memory_order_relaxed );
+                continue;
+            }
+            n = 0;
+            while ( n < limit && n < count &&
+                    m_cells[(pos + n) & m_mask].seq.load( std::memory_order_acquire ) == pos + n )
+            {
+                n++;
+            }
+            if ( n == 0 )
+            {
+                size_t head = m_pos->head.load( std::memory_order_relaxed );
+                if ( head == pos )
+                {
+                    return 0;
+                }
+                pos = head;
+            }
+            else if ( m_pos->head.compare_exchange_weak( pos, pos + n, std::memory_order_relaxed ) )
+            {
+                break;
+            }
+        }
+        for (int i = 0; i < n; i++)
+        {
+            cell &c = m_cells[(pos + i) & m_mask];
+            c.data = e[i];
+            c.seq.store( pos + i + 1, std::memory_order_release );
+        }
+        return n;
+    }
+
+    /**
+     * Takes the oldest element. Called by the consumer, never waits: returns
+     * false if the queue is empty, or the oldest cell is locked by a producer.
+     */
+    bool pop( T &e )
+    {
+        for (;;)
+        {
+            size_t pos = m_pos->tail.load( std::memory_order_acquire );
+            size_t seq = pos + 1;
+            // The cell is locked before reading, since producers can evict it
+            if ( take( pos, seq, e ) )
+            {
+                return true;
+            }
+            if ( seq == LOCKED || static_cast<intptr_t>( seq - (pos + 1) ) < 0 )
+            {
+                return false;
+            }
+            // The element is evicted by a producer, take the next one
+        }
+    }
+
+    /**
+     * Takes the oldest element to free room for the new one. Called by producers,
+     * waits for the cell, locked by other threads. Returns false if the queue is empty.
+     */
+    bool evict( T &e )
+    {
+        for (;;)
+        {
+            size_t pos = m_pos->tail.load( std::memory_order_acquire );
+            size_t seq = pos + 1;
+            if ( take( pos, seq, e ) )
+            {
+                return true;
+            }
+            if ( seq == LOCKED )
+            {
+                std::this_thread::yield();
+            }
+            else if ( static_cast<intptr_t>( seq - (pos + 1) ) < 0 )
+            {
+                return false;
+            }
+        }
+    }
+
+    /**
+     * Replaces the oldest element, matching the predicate, with the new one.
+     * Returns false if there is no such element.
+     */
+    template <typename P>
+    bool replace( const T &e, P match )
+    {
+        size_t head = m_pos->head.load( std::memory_order_relaxed );
+        for (size_t pos = m_pos->tail.load( std::memory_order_acquire ); pos != head; pos++)
+        {
+            cell &c = m_cells[pos & m_mask];
+            size_t seq = pos + 1;
+            // Skip consumed, not yet written and locked cells
+            if ( !c.seq.compare_exchange_strong( seq, LOCKED, std::memory_order_acquire ) )
+            {
+                continue;
+            }
+            bool found = match( c.data );
+            if ( found )
+            {
+                c.data = e;
+            }
+            c.seq.store( pos + 1, std::memory_order_release );
+            if ( found )
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Doubles the capacity, but not above the ceiling. Returns false if the
+     * queue has already reached the ceiling.
+     */
+    bool grow()
+    {
+        int limit = m_limit.load( std::memory_order_relaxed );
+        while ( limit < m_ceiling )
+        {
+            int next = limit * 2 < m_ceiling ? limit * 2 : m_ceiling;
+            if ( m_limit.compare_exchange_weak( limit, next, std::memory_order_relaxed ) )
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool empty() const
+    {
+        size_t pos = m_pos->tail.load( std::memory_order_relaxed );
+        size_t seq = m_cells[pos & m_mask].seq.load( std::memory_order_acquire );
+        return seq != pos + 1 && seq != LOCKED;
+    }
+
+    int size() const
+    {
+        return static_cast<int>( m_pos->head.load( std::memory_order_relaxed ) - m_pos->tail.load( std::memory_order_relaxed ) );
+    }
+
+    int capacity() const { return m_limit.load( std::memory_order_relaxed ); }
+
+private:
+    struct cell
+    {
+        std::atomic<size_t> seq;
+        T data;
+    };
+
+    static constexpr size_t LOCKED = ~static_cast<size_t>( 0 );
+
+    // Takes the element at pos, if its cell has expected sequence number. On failure
+    // seq holds the actual sequence number
+    bool take( size_t pos, size_t &seq, T &e )
+    {
+        cell &c = m_cells[pos & m_mask];
+        if ( !c.seq.compare_exchange_strong( seq, LOCKED, std::memory_order_acquire ) )
+        {
+            return false;
+        }
+        e = c.data;
+        m_pos->tail.store( pos + 1, std::memory_order_release );
+        c.seq.store( pos + m_mask + 1, std::memory_order_release );
+        return true;
+    }
+
+    // Number of cells, which can be claimed at position pos without exceeding the capacity,
+    // or -1 if pos is stale: the consumer has already moved past it
+    intptr_t vacant(size_t pos) const
+    {
+        intptr_t limit = m_limit.load( std::memory_order_relaxed );
+        if ( static_cast<size_t>( limit ) > m_mask )
+        {
+            // The whole ring is available, cell sequence numbers do the check
+            return static_cast<intptr_t>( m_mask + 1 );
+        }
+        intptr_t used = static_cast<intptr_t>( pos - m_pos->tail.load( std::memory_order_acquire ) );
+        if ( used < 0 )
+        {
+            return -1;
+        }
+        return used < limit ? limit - used : 0;
+    }
+
+    static size_t roundUp(int n)
+    {
+        // Sequence numbers of written and free cells are equal in the ring of single cell
+        size_t size = 2;
+        while ( size < static_cast<size_t>( n ) ) size <<= 1;
+        return size;
+    }
+
+    // producers and consumer positions live on separate cache lines. They are
+    // allocated on the heap, so the queue itself stays small. Padding is used
+    // instead of alignas(), since over-aligned new needs C++17
+    struct positions
+    {
+        std::atomic<size_t> head{0};
+        char headPad[SM_ENGINE_CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+        std::atomic<size_t> tail{0};
+        char tailPad[SM_ENGINE_CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+    };
+
+    size_t m_mask = 0;
+    cell * m_cells = nullptr;
+    positions * m_pos = nullptr;
+    std::atomic<int> m_limit{1};
+    int m_ceiling = 1;
+};
+
+}
+#else
+
+namespace sme {
+
+/**
+ * Bounded ring buffer for single-thread builds. The ring is allocated for the
+ * ceiling capacity, while the number of stored elements is limited by the
+ * current capacity.
+ */
+template <typename T>
+class mpsc_queue
+{
+public:
+    explicit mpsc_queue(int capacity = 1) { reset( capacity ); }
+
+    ~mpsc_queue() { delete[] m_elem; }
+
+    mpsc_queue(const mpsc_queue &) = delete;
+    mpsc_queue &operator=(const mpsc_queue &) = delete;
+
+    void reset(int capacity, int ceiling = 0)
+    {
+        if ( capacity < 1 ) capacity = 1;
+        if ( ceiling < capacity ) ceiling = capacity;
+        delete[] m_elem;
+        m_elem = new T[ceiling];
+        m_ceiling = ceiling;
+        m_capacity = capacity;
+        m_tail = 0;
+        m_size = 0;
+    }
+
+    bool push( const T &e )
+    {
+        if ( m_size >= m_capacity ) return false;
+        m_elem[(m_tail + m_size++) % m_ceiling] = e;
+        return true;
+    }
+
+    int push( const T *e, int count )
+    {
+        int n = 0;
+        while ( n < count && push( e[n] ) ) n++;
+        return n;
+    }
+
+    bool pop( T &e )
+    {
+        if ( m_size == 0 ) return false;
+        e = m_elem[m_tail];
+        m_tail = (m_tail + 1) % m_ceiling;
+        m_size--;
+        return true;
+    }
+
+    bool evict( T &e ) { return pop( e ); }
+
+    template <typename P>
+    bool replace( const T &e, P match )
+    {
+        for (int i = 0; i < m_size; i++)
+        {
+            T &elem = m_elem[(m_tail + i) % m_ceiling];
+            if ( match( elem ) )
+            {
+                elem = e;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool grow()
+    {
+        if ( m_capacity >= m_ceiling ) return false;
+        m_capacity = m_capacity * 2 < m_ceiling ? m_capacity * 2 : m_ceiling;
+        return true;
+    }
+
+    bool empty() const { return m_size == 0; }
+
+    int size() const { return m_size; }
+
+    int capacity() const { return m_capacity; }
+
+private:
+    T * m_elem = nullptr;
+    int m_capacity = 0;
+    int m_ceiling = 1;
+    int m_tail = 0;
+    int m_size = 0;
+};
+
+}
+#endif
@@ -63,7 +63,7 @@ public:
 
     void clear() { m_ptr = 0; }
 
-    int size() { return m_ptr; }
+    int size() const { return m_ptr; }
 
     bool empty() { return m_ptr == 0; }
 
@@ -71,6 +71,8 @@ public:
 
     T& back() { return m_elem[m_ptr - 1]; }
 
+    void pop_back() { if ( m_ptr ) m_ptr--; }
+
     T& operator[] (int n) { return m_elem[n]; }
 
     const T& operator[] (int n) const { return m_elem[n]; }
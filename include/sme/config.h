@@ -50,3 +50,29 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #endif
 
 
+/** Number of event queue priority lanes, lane 0 has the highest priority */
+#ifndef SM_ENGINE_PRIORITY_LANES
+#if defined(__AVR__)
+    #define SM_ENGINE_PRIORITY_LANES 1
+#else
+    #define SM_ENGINE_PRIORITY_LANES 3
+#endif
+#endif
+
+#ifndef SM_ENGINE_CACHE_LINE_SIZE
+    #define SM_ENGINE_CACHE_LINE_SIZE 64
+#endif
+
+/** Pollable eventfd/timerfd wake handles, see ISmEngine::enablePollFds() */
+#ifndef SM_ENGINE_POLL_FD
+#if defined(__linux__) && SM_ENGINE_MULTITHREAD
+    #define SM_ENGINE_POLL_FD 1
+#else
+    #define SM_ENGINE_POLL_FD 0
+#endif
+#endif
+
+/** Direct StateUid-indexed state table, built by ISmEngine::begin() */
+#ifndef SM_ENGINE_STATE_INDEX
+    #define SM_ENGINE_STATE_INDEX SM_ENGINE_USE_STL
+#endif
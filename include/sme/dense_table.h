@@ -0,0 +1,269 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2020, Aleksei Dynda
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "../sme/config.h"
+#include "../sme/event.h"
+#include "../sme/state_uid.h"
+#include "../sme/transition.h"
+#include "../sme/generic_state.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if __cplusplus >= 201703L
+
+/**
+ * Single row of declarative transition table. Fields have the same meaning as
+ * TRANSITION() macro arguments, and source can be SM_STATE_ANY.
+ */
+typedef struct
+{
+    StateUid source;
+    uint8_t event;
+    uintptr_t arg;
+    void (*func)(void);
+    EEventResult type;
+    StateUid dest;
+} SmTransitionRow;
+
+#define ROW_TRANSITION(source_id, event_id, event_arg, func, type, dest_id) \
+             { source_id, event_id, event_arg, func, type, dest_id }
+
+#define ROW_SIMPLE(source_id, event_id, func, dest_id) \
+             ROW_TRANSITION(source_id, event_id, SM_EVENT_ARG_ANY, func, EEventResult::SWITCH_STATE, dest_id)
+
+#define ROW_SWITCH(source_id, event_id, event_arg, func, dest_id) \
+             ROW_TRANSITION(source_id, event_id, event_arg, func, EEventResult::SWITCH_STATE, dest_id)
+
+#define ROW_PUSH(source_id, event_id, event_arg, func, dest_id) \
+             ROW_TRANSITION(source_id, event_id, event_arg, func, EEventResult::PUSH_STATE, dest_id)
+
+#define ROW_POP(source_id, event_id, event_arg, func) \
+             ROW_TRANSITION(source_id, event_id, event_arg, func, EEventResult::POP_STATE, SM_STATE_NONE)
+
+#define ROW_NO_TRANSITION(source_id, event_id, event_arg, func) \
+             ROW_TRANSITION(source_id, event_id, event_arg, func, EEventResult::PROCESSED_AND_HOOKED, SM_STATE_NONE)
+
+/**
+ * Declares that the transition table is built from the rows, so states and engines
+ * with the table get their event interest from the rows automatically.
+ * Must be used at global namespace scope.
+ *
+ * @code{.cpp}
+ * SM_ROW_TABLE_INTEREST(sme::denseTable<lampRows>, lampRows)
+ * @endcode
+ */
+#define SM_ROW_TABLE_INTEREST(x, rows) \
+             namespace sme { template <> struct TableInterest<x> \
+             { static const SmEventMask *get(StateUid sid) { return RowInterest<rows>::get( sid ); } }; }
+
+namespace sme
+{
+    template <typename T, size_t N>
+    constexpr size_t rowCount(const T (&)[N]) { return N; }
+
+    constexpr bool rowMatches(const SmTransitionRow &row, int state, int event)
+    {
+        return row.event == event && (row.source == SM_STATE_ANY || row.source == state);
+    }
+
+    /**
+     * Dense [state][event] matrix, built from the rows at compile time.
+     * Each cell points to the list of rows for the pair, in table order. Rows with
+     * exact argument are checked one by one, so the matrix keeps first-match semantics
+     * of macro tables. The last matrix row is used for states, which do not appear
+     * as a source in the table.
+     */
+    template <const auto &rows>
+    struct DenseMatrix
+    {
+        static constexpr size_t ROWS = rowCount( rows );
+        static constexpr uint16_t END = 0xFFFF;
+
+        static constexpr int stateCount()
+        {
+            int count = 0;
+            for (size_t r = 0; r < ROWS; r++)
+            {
+                if ( rows[r].source != SM_STATE_ANY && rows[r].source >= count )
+                {
+                    count = rows[r].source + 1;
+                }
+            }
+            return count;
+        }
+
+        static constexpr int STATES = stateCount() + 1;
+
+        static constexpr bool firstForEvent(int state, size_t r)
+        {
+            for (size_t i = 0; i < r; i++)
+            {
+                if ( rowMatches( rows[i], state, rows[r].event ) ) return false;
+            }
+            return true;
+        }
+
+        static constexpr size_t listSize()
+        {
+            size_t size = 0;
+            for (int state = 0; state < STATES; state++)
+            {
+                for (size_t r = 0; r < ROWS; r++)
+                {
+                    if ( rowMatches( rows[r], state, rows[r].event ) && firstForEvent( state, r ) )
+                    {
+                        for (size_t i = r; i < ROWS; i++)
+                        {
+                            size += rowMatches( rows[i], state, rows[r].event ) ? 1 : 0;
+                        }
+                        size++;
+                    }
+                }
+            }
+            return size;
+        }
+
+        static_assert( listSize() < END, "transition table is too large for dense matrix" );
+
+        struct Data
+        {
+            uint16_t cells[STATES][256];
+            uint16_t list[listSize() + 1];
+        };
+
+        static constexpr Data build()
+        {
+            Data data{};
+            uint16_t size = 0;
+            for (int state = 0; state < STATES; state++)
+            {
+                for (size_t r = 0; r < ROWS; r++)
+                {
+                    if ( rowMatches( rows[r], state, rows[r].event ) && firstForEvent( state, r ) )
+                    {
+                        data.cells[state][rows[r].event] = size + 1;
+                        for (size_t i = r; i < ROWS; i++)
+                        {
+                            if ( rowMatches( rows[i], state, rows[r].event ) )
+                            {
+                                data.list[size++] = static_cast<uint16_t>( i );
+                            }
+                        }
+                        data.list[size++] = END;
+                    }
+                }
+            }
+            return data;
+        }
+
+        static constexpr Data data = build();
+    };
+
+    /**
+     * Event ids, which the rows can process in each state, built at compile time
+     */
+    template <const auto &rows>
+    struct RowInterest
+    {
+        static constexpr size_t ROWS = rowCount( rows );
+        // States from the table, states without rows, and all states
+        static constexpr int STATES = DenseMatrix<rows>::STATES;
+
+        struct Data
+        {
+            SmEventMask masks[STATES + 1];
+        };
+
+        static constexpr Data build()
+        {
+            Data data{};
+            for (int state = 0; state <= STATES; state++)
+            {
+                for (size_t r = 0; r < ROWS; r++)
+                {
+                    if ( state == STATES || rowMatches( rows[r], state, rows[r].event ) )
+                    {
+                        data.masks[state].bits[rows[r].event >> 5] |= 1u << (rows[r].event & 31);
+                    }
+                }
+            }
+            return data;
+        }
+
+        static constexpr Data data = build();
+
+        static const SmEventMask *get(StateUid sid)
+        {
+            return &data.masks[sid == SM_STATE_ANY ? STATES : (sid < STATES - 1 ? sid : STATES - 1)];
+        }
+    };
+
+    /**
+     * Transition table function, built from the array of SmTransitionRow.
+     * It can be used everywhere TSmeTable is expected, for example in GenericState and
+     * GenericStateEngine, and finds the row with single indexed load instead of if-chain.
+     *
+     * @code{.cpp}
+     * static constexpr SmTransitionRow lampRows[] =
+     * {
+     *     ROW_SIMPLE(STATE_OFF, EVENT_BUTTON, sme::NO_FUNC, STATE_ON),
+     *     ROW_SIMPLE(STATE_ON, EVENT_BUTTON, sme::NO_FUNC, STATE_OFF),
+     * };
+     * GenericStateEngine<sme::denseTable<lampRows>> lamp(statesList);
+     * @endcode
+     */
+    template <const auto &rows>
+    STransitionData denseTable(StateUid sid, SEventData event)
+    {
+        using Matrix = DenseMatrix<rows>;
+        int state = sid < Matrix::STATES - 1 ? sid : Matrix::STATES - 1;
+        uint16_t cell = Matrix::data.cells[state][event.event];
+        if ( cell )
+        {
+            for (const uint16_t *index = &Matrix::data.list[cell - 1]; *index != Matrix::END; index++)
+            {
+                const SmTransitionRow &row = rows[*index];
+                if ( row.arg == SM_EVENT_ARG_ANY || row.arg == event.arg )
+                {
+                    if ( row.func ) row.func();
+                    return { row.type, row.dest };
+                }
+            }
+        }
+        return { EEventResult::NOT_PROCESSED, SM_STATE_NONE };
+    }
+}
+
+#endif
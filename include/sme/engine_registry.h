@@ -0,0 +1,370 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2020, Aleksei Dynda
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "../sme/config.h"
+#include "../sme/iengine.h"
+
+#if SM_ENGINE_USE_STL
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#if SM_ENGINE_MULTITHREAD
+#include <mutex>
+#endif
+#include <queue>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <stdint.h>
+
+/**
+ * Maps keys, for example device or session ids, to state machine engines.
+ *
+ * Engines are created by the factory on the first access to the key, and
+ * are driven by processReady() calls. Engines report new work through the
+ * notifier, so processReady() cost scales with the number of engines, which
+ * have events or due deadlines. hibernate() replaces idle engines with
+ * compact snapshots, so memory scales with the number of active keys. Hibernated
+ * engine is resumed, when the key is accessed again, or when its nearest timer
+ * is due. The class is not thread-safe.
+ */
+template <typename Key, typename Hash = std::hash<Key>>
+class SmEngineRegistry
+{
+public:
+    /**
+     * Creates new engine for the key. The registry sets the notifier and starts
+     * the engine itself
+     */
+    typedef std::function<ISmEngine *(const Key &key)> Factory;
+
+    /**
+     * Creates registry
+     *
+     * @param factory function, creating engines
+     * @param initial initial state of new engines
+     */
+    SmEngineRegistry(Factory factory, StateUid initial)
+        : m_factory( factory )
+        , m_initial( initial )
+    {
+    }
+
+    virtual ~SmEngineRegistry()
+    {
+        for (auto &item: m_resident)
+        {
+            item.second.engine->end();
+        }
+    }
+
+    /**
+     * Sends event to the engine of the key, creating or resuming it if needed
+     */
+    bool sendEvent(const Key &key, SEventData event)
+    {
+        ISmEngine *engine = get( key );
+        return engine != nullptr && engine->sendEvent( event );
+    }
+
+    /**
+     * Returns engine of the key, creating or resuming it if needed.
+     * Returns nullptr, if the engine cannot be created.
+     */
+    ISmEngine *get(const Key &key)
+    {
+        auto it = m_resident.find( key );
+        if ( it != m_resident.end() )
+        {
+            return it->second.engine.get();
+        }
+        ISmEngine *engine = m_factory( key );
+        if ( engine == nullptr )
+        {
+            return nullptr;
+        }
+        // The entry is created first, since the notifier is called from begin() and resume()
+        Resident &resident = m_resident[key];
+        resident.engine.reset( engine );
+        resident.owner = this;
+        resident.key = key;
+        resident.lastActive = getMicros();
+        engine->setNotifier( &SmEngineRegistry::notify, &resident );
+        auto hibernated = m_hibernated.find( key );
+        if ( hibernated != m_hibernated.end() )
+        {
+            if ( !engine->begin() || !engine->resume( hibernated->second.snapshot ) )
+            {
+                m_resident.erase( key );
+                return nullptr;
+            }
+            m_hibernated.erase( hibernated );
+        }
+        else if ( !engine->begin( m_initial ) )
+        {
+            m_resident.erase( key );
+            return nullptr;
+        }
+        addWakeup( resident, resident.lastActive );
+        return engine;
+    }
+
+    /**
+     * Removes the engine of the key. Resident engine is stopped with end()
+     */
+    void remove(const Key &key)
+    {
+        auto it = m_resident.find( key );
+        if ( it != m_resident.end() )
+        {
+            it->second.engine->end();
+            m_resident.erase( it );
+        }
+        m_hibernated.erase( key );
+    }
+
+    /**
+     * @brief processes resident engines, which have events or due deadlines
+     *
+     * Hibernated engines with due timers are resumed and processed too.
+     *
+     * @return number of processed engines
+     */
+    int processReady()
+    {
+        uint64_t now = getMicros();
+        while ( !m_wakeups.empty() && m_wakeups.top().first <= now )
+        {
+            Wakeup wakeup = m_wakeups.top();
+            m_wakeups.pop();
+            auto it = m_resident.find( wakeup.second );
+            if ( it == m_resident.end() )
+            {
+                // Entries, pushed before the engine was hibernated, do not resume it
+                auto hibernated = m_hibernated.find( wakeup.second );
+                if ( hibernated != m_hibernated.end() && hibernated->second.wakeup == wakeup.first )
+                {
+                    get( wakeup.second );
+                }
+            }
+            else if ( it->second.wakeup == wakeup.first )
+            {
+                it->second.wakeup = UINT64_MAX;
+                markReady( it->second );
+            }
+        }
+        // Handlers can create and remove engines, so the keys are looked up again
+        std::vector<Key> ready;
+        {
+#if SM_ENGINE_MULTITHREAD
+            std::unique_lock<std::mutex> lock( m_readyMutex );
+#endif
+            ready.swap( m_ready );
+        }
+        int count = 0;
+        for (const Key &key: ready)
+        {
+            auto it = m_resident.find( key );
+            if ( it == m_resident.end() )
+            {
+                continue;
+            }
+            Resident &resident = it->second;
+            {
+#if SM_ENGINE_MULTITHREAD
+                std::unique_lock<std::mutex> lock( m_readyMutex );
+#endif
+                // The key can be listed twice, if the engine was removed and created again
+                if ( !resident.ready )
+                {
+                    continue;
+                }
+                resident.ready = false;
+            }
+            resident.engine->processReady();
+            resident.lastActive = now;
+            addWakeup( resident, now );
+            count++;
+        }
+        return count;
+    }
+
+    /**
+     * @brief hibernates engines without pending events, which were not processed for idleMs
+     *
+     * @param idleMs idle time in milliseconds
+     * @return number of hibernated engines
+     */
+    int hibernate(uint32_t idleMs)
+    {
+        uint64_t now = getMicros();
+        int count = 0;
+        for (auto it = m_resident.begin(); it != m_resident.end(); )
+        {
+            ISmEngine &engine = *it->second.engine;
+            if ( engine.hasPendingEvents() || now - it->second.lastActive < static_cast<uint64_t>( idleMs ) * 1000 )
+            {
+                ++it;
+                continue;
+            }
+            Hibernated &hibernated = m_hibernated[it->first];
+            engine.hibernate( hibernated.snapshot );
+            // Cached engine deadline can belong to cancelled timer, the snapshot has exact one
+            uint64_t remaining = hibernated.snapshot.stateTimeout;
+            for (const SmTimerRecord &timer: hibernated.snapshot.timers)
+            {
+                remaining = timer.deadline < remaining ? timer.deadline : remaining;
+            }
+            hibernated.wakeup = remaining != UINT64_MAX ? now + remaining : UINT64_MAX;
+            // The entry, pushed while the engine was resident, is reused
+            if ( hibernated.wakeup != UINT64_MAX && hibernated.wakeup != it->second.wakeup )
+            {
+                m_wakeups.push( { hibernated.wakeup, it->first } );
+            }
+            it = m_resident.erase( it );
+            count++;
+        }
+        return count;
+    }
+
+    /**
+     * Returns number of engines in memory
+     */
+    size_t getResidentCount() const { return m_resident.size(); }
+
+    /**
+     * Returns number of hibernated engines
+     */
+    size_t getHibernatedCount() const { return m_hibernated.size(); }
+
+    /**
+     * Returns monotonic timestamp in microseconds. Override it on platforms
+     * without std::chrono support.
+     */
+    virtual uint64_t getMicros()
+    {
+        return std::chrono::time_point_cast<std::chrono::microseconds>(
+                   std::chrono::steady_clock::now() ).time_since_epoch().count();
+    }
+
+private:
+    struct Resident
+    {
+        std::unique_ptr<ISmEngine> engine{};
+        SmEngineRegistry *owner = nullptr;
+        Key key{};
+        uint64_t lastActive = 0;
+        // The nearest pending entry in m_wakeups
+        uint64_t wakeup = UINT64_MAX;
+        // The key is in m_ready list, protected by m_readyMutex
+        bool ready = false;
+    };
+
+    struct Hibernated
+    {
+        SmEngineSnapshot snapshot{};
+        // The only entry in m_wakeups, which resumes the engine
+        uint64_t wakeup = UINT64_MAX;
+    };
+
+    typedef std::pair<uint64_t, Key> Wakeup;
+
+    struct Later
+    {
+        bool operator()(const Wakeup &a, const Wakeup &b) const { return a.first > b.first; }
+    };
+
+    Factory m_factory;
+    StateUid m_initial;
+    std::unordered_map<Key, Resident, Hash> m_resident{};
+    std::unordered_map<Key, Hibernated, Hash> m_hibernated{};
+    // Deadlines of resident and hibernated engines, stale entries are skipped
+    std::priority_queue<Wakeup, std::vector<Wakeup>, Later> m_wakeups{};
+    // Keys of resident engines, which reported new work
+    std::vector<Key> m_ready{};
+#if SM_ENGINE_MULTITHREAD
+    std::mutex m_readyMutex{};
+#endif
+
+    static void notify(ISmEngine *engine, void *arg)
+    {
+        Resident *resident = static_cast<Resident *>( arg );
+        if ( resident->engine.get() == engine )
+        {
+            resident->owner->markReady( *resident );
+        }
+    }
+
+    void markReady(Resident &resident)
+    {
+#if SM_ENGINE_MULTITHREAD
+        std::unique_lock<std::mutex> lock( m_readyMutex );
+#endif
+        if ( !resident.ready )
+        {
+            resident.ready = true;
+            m_ready.push_back( resident.key );
+        }
+    }
+
+    // Returns the nearest deadline of the engine in registry clock, since getMicros() can be overridden
+    static uint64_t toRegistryClock(ISmEngine &engine, uint64_t now)
+    {
+        uint64_t deadline = engine.getNextDeadline();
+        if ( deadline == UINT64_MAX )
+        {
+            return UINT64_MAX;
+        }
+        uint64_t engineNow = engine.getMicros();
+        return now + (deadline > engineNow ? deadline - engineNow : 0);
+    }
+
+    void addWakeup(Resident &resident, uint64_t now)
+    {
+        uint64_t deadline = toRegistryClock( *resident.engine, now );
+        if ( deadline == UINT64_MAX )
+        {
+            return;
+        }
+        if ( deadline < resident.wakeup )
+        {
+            resident.wakeup = deadline;
+            m_wakeups.push( { deadline, resident.key } );
+        }
+    }
+};
+
+#endif
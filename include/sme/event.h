@@ -41,14 +41,44 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 typedef uint8_t StateUid;
 
+/**
+ * Handle of deferred event. SM_TIMER_INVALID means that timer is not started.
+ */
+typedef uint32_t SmTimerHandle;
+
+#define SM_TIMER_INVALID   0
+
+/**
+ * Defines how periodic timer handles ticks, missed because engine was busy
+ */
+enum class ETimerPolicy: uint8_t
+{
+    /** Ticks, late by one period or more, are dropped. Next tick fires on schedule */
+    SKIP,
+    /** All missed ticks are fired one after another */
+    CATCH_UP,
+    /** All missed ticks are merged into single event */
+    COALESCE,
+};
+
 typedef struct
 {
     uint8_t event;
     uintptr_t arg;
 } SEventData;
 
+/**
+ * Set of event ids, bit per id
+ */
 typedef struct
 {
-    SEventData event;
-    uint32_t micros;
-} __SDeferredEventData;
+    uint32_t bits[8];
+} SmEventMask;
+
+namespace sme
+{
+    static inline bool hasEvent(const SmEventMask &mask, uint8_t eventId)
+    {
+        return (mask.bits[eventId >> 5] >> (eventId & 31)) & 1;
+    }
+}
@@ -0,0 +1,147 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2020, Aleksei Dynda
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "../sme/iengine.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief producer-side staging buffer for state machine events
+ *
+ * Collects events in local memory and puts them to the engine queue with
+ * single sendEvents() call, so the producer pays for the queue access and for
+ * the engine wake-up once per batch. The buffer is not thread-safe: use separate
+ * buffer for each producer thread, for example, declare it as thread_local.
+ *
+ * @tparam N capacity of the buffer
+ */
+template <int N>
+class SmEventBuffer
+{
+public:
+    /**
+     * Creates staging buffer for the engine
+     *
+     * @param engine engine to send events to
+     * @param flushTimeoutMs if not 0, the buffer is flushed by sendEvent() and
+     *        flushIfDue(), when the oldest staged event waits longer than specified
+     *        timeout
+     */
+    SmEventBuffer(ISmEngine &engine, uint32_t flushTimeoutMs = 0)
+        : m_engine( engine )
+        , m_flushTimeout( static_cast<uint64_t>( flushTimeoutMs ) * 1000 )
+    {
+    }
+
+    ~SmEventBuffer() { flush(); }
+
+    /**
+     * Stages the event. The buffer is flushed automatically, when it is full
+     * or flush timeout is over.
+     * Returns false, if the buffer is full and engine queue has no free space.
+     */
+    bool sendEvent(SEventData event)
+    {
+        if ( m_count == N && flush() == 0 )
+        {
+            return false;
+        }
+        if ( m_count == 0 && m_flushTimeout )
+        {
+            m_firstTs = m_engine.getMicros();
+        }
+        m_events[m_count++] = event;
+        if ( m_count == N || ( m_flushTimeout && m_engine.getMicros() - m_firstTs >= m_flushTimeout ) )
+        {
+            flush();
+        }
+        return true;
+    }
+
+    /**
+     * Puts all staged events to the engine queue. Events, which do not fit the
+     * queue, remain in the buffer. Returns number of events sent.
+     */
+    size_t flush()
+    {
+        if ( m_count == 0 )
+        {
+            return 0;
+        }
+        size_t sent = m_engine.sendEvents( m_events, m_count );
+        for (size_t i = sent; i < m_count; i++)
+        {
+            m_events[i - sent] = m_events[i];
+        }
+        m_count -= sent;
+        return sent;
+    }
+
+    /**
+     * Flushes the buffer, if the oldest staged event waits longer than flush timeout.
+     * sendEvent() checks the timeout only, when new event is staged, so the producer
+     * loop must call this method to bound the latency, when it has no new events.
+     * Returns number of events sent.
+     */
+    size_t flushIfDue()
+    {
+        if ( m_count == 0 || !m_flushTimeout || m_engine.getMicros() - m_firstTs < m_flushTimeout )
+        {
+            return 0;
+        }
+        return flush();
+    }
+
+    /**
+     * Returns the time in getMicros() units, when flushIfDue() must be called,
+     * or UINT64_MAX if there is nothing to flush by timeout
+     */
+    uint64_t getFlushDeadline() const
+    {
+        return m_count && m_flushTimeout ? m_firstTs + m_flushTimeout : UINT64_MAX;
+    }
+
+    /**
+     * Returns number of staged events
+     */
+    size_t size() const { return m_count; }
+
+private:
+    ISmEngine &m_engine;
+    uint64_t m_flushTimeout;
+    uint64_t m_firstTs = 0;
+    SEventData m_events[N];
+    size_t m_count = 0;
+};
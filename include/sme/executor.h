@@ -0,0 +1,167 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2020, Aleksei Dynda
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "../sme/config.h"
+#include "../sme/iengine.h"
+
+#if SM_ENGINE_MULTITHREAD && SM_ENGINE_USE_STL
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include <stdint.h>
+
+/**
+ * Runs many state machine engines on a fixed pool of worker threads.
+ *
+ * Engine is scheduled only when it has events in the queue, or when its nearest
+ * timer or state timeout is due. Each worker has own run queue, idle workers steal
+ * engines from busy ones. Every engine is processed by single thread at a time, so
+ * the events are still handled one by one, in run-to-completion manner.
+ */
+class SmExecutor
+{
+public:
+    /**
+     * Creates executor
+     *
+     * @param workers number of worker threads, 0 means number of cpu cores
+     */
+    explicit SmExecutor(int workers = 0);
+
+    ~SmExecutor();
+
+    SmExecutor(const SmExecutor &) = delete;
+    SmExecutor &operator=(const SmExecutor &) = delete;
+
+    /**
+     * @brief adds engine to the executor
+     *
+     * The engine must be started with begin(), and must not be driven by loop(),
+     * update() or processReady() calls from other threads. The engine must live
+     * until the executor is destroyed.
+     *
+     * @param engine state machine engine
+     */
+    void add(ISmEngine &engine);
+
+    /**
+     * Starts worker threads
+     */
+    void start();
+
+    /**
+     * Stops worker threads. The engines keep their events and timers.
+     */
+    void stop();
+
+    /**
+     * Returns number of times idle workers took engines from other workers
+     */
+    uint32_t getSteals() const { return m_steals.load( std::memory_order_relaxed ); }
+
+private:
+    enum
+    {
+        IDLE,
+        QUEUED,
+        RUNNING,
+        NOTIFIED,
+    };
+
+    struct Task
+    {
+        ISmEngine *engine;
+        SmExecutor *owner;
+        std::atomic<uint8_t> state{IDLE};
+        // The nearest pending entry in the timer heap, protected by m_mutex
+        uint64_t timerDeadline = UINT64_MAX;
+    };
+
+    struct Worker
+    {
+        std::mutex mutex{};
+        std::deque<Task *> queue{};
+        std::thread thread{};
+    };
+
+    struct Timer
+    {
+        uint64_t deadline;
+        Task *task;
+        bool operator>(const Timer &other) const { return deadline > other.deadline; }
+    };
+
+    std::vector<std::unique_ptr<Worker>> m_workers{};
+    std::vector<std::unique_ptr<Task>> m_tasks{};
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> m_timers{};
+    // Protects tasks list and timer heap, idle workers sleep on it
+    std::mutex m_mutex{};
+    std::condition_variable m_cond{};
+    std::atomic<int> m_sleeping{0};
+    std::atomic<bool> m_running{false};
+    std::atomic<uint32_t> m_nextWorker{0};
+    std::atomic<uint32_t> m_steals{0};
+    // Copy of the nearest timer deadline, allows to skip locking m_mutex
+    std::atomic<uint64_t> m_nextTimer{UINT64_MAX};
+
+    static void notify(ISmEngine *engine, void *arg);
+
+    static uint64_t now();
+
+    void schedule(Task *task);
+
+    void push(Task *task);
+
+    Task *pop(int index);
+
+    bool hasWork();
+
+    void execute(Task *task);
+
+    void addTimer(Task *task, uint64_t deadline);
+
+    // Moves due timers to the list, m_mutex must be locked
+    void takeDueTimers(uint64_t ts, std::vector<Task *> &due);
+
+    void run(int index);
+};
+
+#endif
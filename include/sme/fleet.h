@@ -0,0 +1,246 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2020, Aleksei Dynda
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "../sme/config.h"
+#include "../sme/event.h"
+#include "../sme/state_uid.h"
+#include "../sme/transition.h"
+#include "../sme/generic_state.h"
+#include "../sme/dense_table.h"
+
+#if SM_ENGINE_USE_STL
+
+#include <vector>
+
+#include <stdint.h>
+
+/** Value of pending event slot, which has no event */
+#define SM_FLEET_NO_EVENT  0x100
+
+namespace sme
+{
+    /**
+     * Applies pending events of fleet instances using dense transition table.
+     * Table entry SM_STATE_NONE means that the transition must be done by the slow
+     * path: such instances are not changed, and their indices are put to slow array.
+     *
+     * @return number of instances, which need slow path
+     */
+    int fleetStep(uint8_t *states, uint16_t *events, const uint8_t *next, int columns,
+                  int count, int *slow, bool vectorized);
+
+    /**
+     * Returns true if vectorized fleet step is supported by the cpu
+     */
+    bool fleetVectorized();
+}
+
+#if __cplusplus >= 201703L
+
+/**
+ * Steps large number of identical state machines, built from single row table.
+ *
+ * Active states and pending events of all instances are stored in parallel arrays
+ * (structure of arrays), and simple transitions are applied via dense [state][event]
+ * table with vector gathers, when the cpu supports AVX2. The dense table is built
+ * from the rows: transitions, which have actions or depend on event argument, are
+ * not put there, and for them the fleet calls sme::denseTable<rows>, the same table
+ * function GenericStateEngine can use. State ids must be less than the number of
+ * states, given to the constructor.
+ *
+ * @code{.cpp}
+ * SmFleet<lampRows> lamps( 100000, 2 );
+ * @endcode
+ */
+template <const auto &rows>
+class SmFleet
+{
+public:
+    /**
+     * Creates fleet
+     *
+     * @param instances number of state machines
+     * @param states number of states, state ids must be in range [0, states)
+     */
+    SmFleet(int instances, int states)
+        : m_states( instances, SM_STATE_NONE )
+        , m_events( instances, SM_FLEET_NO_EVENT )
+        , m_args( instances, 0 )
+        , m_slow( instances )
+        , m_stateCount( states )
+        // Gather reads 4 bytes, so the table is padded
+        , m_next( states * COLUMNS + 3, SM_STATE_NONE )
+        , m_vectorized( sme::fleetVectorized() )
+    {
+        for (int state = 0; state < states; state++)
+        {
+            m_next[state * COLUMNS + SM_FLEET_NO_EVENT] = static_cast<uint8_t>( state );
+            bool seen[256] = {};
+            // The first matching row decides, like in the table function
+            for (size_t r = 0; r < sme::rowCount( rows ); r++)
+            {
+                const SmTransitionRow &row = rows[r];
+                if ( seen[row.event] || !sme::rowMatches( row, state, row.event ) )
+                {
+                    continue;
+                }
+                seen[row.event] = true;
+                m_next[state * COLUMNS + row.event] = simpleNext( row, state );
+            }
+            // Events without rows are not processed, and the state is kept
+            for (int event = 0; event < 256; event++)
+            {
+                if ( !seen[event] )
+                {
+                    m_next[state * COLUMNS + event] = static_cast<uint8_t>( state );
+                }
+            }
+        }
+    }
+
+    /**
+     * Sets initial state of all instances
+     *
+     * @param initial initial state id, must be less than the number of states
+     * @return false if the state id is out of range, the fleet is not changed then
+     */
+    bool begin(StateUid initial)
+    {
+        if ( initial >= m_stateCount )
+        {
+            return false;
+        }
+        for (auto &state: m_states) state = initial;
+        for (auto &event: m_events) event = SM_FLEET_NO_EVENT;
+        m_started = true;
+        return true;
+    }
+
+    /**
+     * Puts event to the instance. Each instance can have one pending event.
+     * Returns false if the instance already has pending event.
+     */
+    bool sendEvent(int instance, SEventData event)
+    {
+        if ( m_events[instance] != SM_FLEET_NO_EVENT )
+        {
+            return false;
+        }
+        m_events[instance] = event.event;
+        m_args[instance] = event.arg;
+        return true;
+    }
+
+    /**
+     * @brief applies pending events of all instances
+     *
+     * Simple transitions are applied in bulk, then the transition table function
+     * is called for the rest. For them, SWITCH_STATE and PUSH_STATE results change
+     * the state, other results keep it, since the fleet has no state stack.
+     * Nothing is done until begin() sets the states, and pending events are kept.
+     *
+     * @return number of instances, which needed the slow path
+     */
+    int step()
+    {
+        if ( !m_started )
+        {
+            return 0;
+        }
+        int count = sme::fleetStep( m_states.data(), m_events.data(), m_next.data(), COLUMNS,
+                                    static_cast<int>( m_states.size() ), m_slow.data(), m_vectorized );
+        for (int i = 0; i < count; i++)
+        {
+            int instance = m_slow[i];
+            SEventData event = { static_cast<uint8_t>( m_events[instance] ), m_args[instance] };
+            m_events[instance] = SM_FLEET_NO_EVENT;
+            STransitionData result = sme::denseTable<rows>( m_states[instance], event );
+            // States out of range would index past the dense table on the next step
+            if ( (result.result == EEventResult::SWITCH_STATE || result.result == EEventResult::PUSH_STATE) &&
+                 result.stateId < m_stateCount )
+            {
+                m_states[instance] = result.stateId;
+            }
+        }
+        return count;
+    }
+
+    /**
+     * Returns active state of the instance
+     */
+    StateUid getState(int instance) const { return m_states[instance]; }
+
+    /**
+     * Returns number of instances
+     */
+    int size() const { return static_cast<int>( m_states.size() ); }
+
+    /**
+     * Enables vector instructions, if the cpu supports them. Enabled by default.
+     */
+    void setVectorized(bool enable) { m_vectorized = enable && sme::fleetVectorized(); }
+
+private:
+    // All event ids and the column for instances without events
+    static constexpr int COLUMNS = SM_FLEET_NO_EVENT + 1;
+
+    std::vector<uint8_t> m_states;
+    std::vector<uint16_t> m_events;
+    std::vector<uintptr_t> m_args;
+    std::vector<int> m_slow;
+    int m_stateCount;
+    std::vector<uint8_t> m_next;
+    bool m_vectorized;
+    bool m_started = false;
+
+    // Destination of the row, which is applied without calling the table function,
+    // or SM_STATE_NONE if the transition needs slow path
+    uint8_t simpleNext(const SmTransitionRow &row, int state) const
+    {
+        if ( row.arg != SM_EVENT_ARG_ANY || (row.func != nullptr && row.func != sme::NO_FUNC) )
+        {
+            return SM_STATE_NONE;
+        }
+        if ( (row.type != EEventResult::SWITCH_STATE && row.type != EEventResult::PUSH_STATE) ||
+             row.dest == SM_STATE_NONE )
+        {
+            return static_cast<uint8_t>( state );
+        }
+        return row.dest < m_stateCount ? row.dest : SM_STATE_NONE;
+    }
+};
+
+#endif
+
+#endif
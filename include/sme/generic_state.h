@@ -41,18 +41,80 @@ typedef void (*TSmeFunction)(void);
 typedef void (*TSmeEnterFunction)(SEventData *event);
 typedef STransitionData (*TSmeTable)(StateUid, SEventData);
 
+namespace sme
+{
+    template <StateUid id, class T>
+    class StaticState;
+
+    /**
+     * Tells if the transition table is pure: its result depends only on state id,
+     * event id and argument, and its only action is sme::NO_FUNC.
+     * Tables are marked pure with SM_PURE_TABLE().
+     */
+    template <TSmeTable table>
+    struct PureTable
+    {
+        static constexpr bool value = false;
+    };
+
+    /**
+     * Returns event ids, which the transition table can process in the state,
+     * or nullptr for any event. SM_STATE_ANY requests ids for all states.
+     * Tables declare their events with SM_TABLE_INTEREST() or SM_ROW_TABLE_INTEREST().
+     */
+    template <TSmeTable table>
+    struct TableInterest
+    {
+        static const SmEventMask *get(StateUid /*sid*/) { return nullptr; }
+    };
+}
+
+/**
+ * Marks transition table as pure, so that engines can cache its results.
+ * Must be used at global namespace scope after the table declaration.
+ */
+#define SM_PURE_TABLE(x) \
+             namespace sme { template <> struct PureTable<x> { static constexpr bool value = true; }; }
+
+/**
+ * Declares event ids, which the transition table can process in any state.
+ * Must be used at global namespace scope after the table declaration.
+ *
+ * @param x transition table
+ * @param mask SmEventMask object with static storage duration
+ */
+#define SM_TABLE_INTEREST(x, mask) \
+             namespace sme { template <> struct TableInterest<x> \
+             { static const SmEventMask *get(StateUid /*sid*/) { return &mask; } }; }
+
 template <TSmeEnterFunction enterFunc, TSmeFunction updateFunc, TSmeEnterFunction exitFunc, TSmeTable table>
 class GenericState: public SmState
 {
 public:
-    GenericState(const char *name): SmState( name ) { }
-    GenericState(StateUid uid, const char *name = nullptr): SmState( name ) { setId( uid ); }
+    GenericState(const char *name): SmState( name ) { setPure( sme::PureTable<table>::value ); }
+    GenericState(StateUid uid, const char *name = nullptr): SmState( name )
+    {
+        setPure( sme::PureTable<table>::value );
+        setId( uid );
+    }
 
 private:
+    template <StateUid id, class T>
+    friend class sme::StaticState;
+
     void enter(SEventData *event) override final { enterFunc(event); }
     void update() override final { updateFunc(); }
     void exit(SEventData *event) override final { exitFunc(event); }
     STransitionData onEvent(SEventData event) override final { return table( getId(), event); }
+
+    // Interest mask depends on state id, so it is derived for both constructors
+    void onSetId() override
+    {
+        if ( getEventInterest() == nullptr )
+        {
+            setEventInterest( sme::TableInterest<table>::get( getId() ) );
+        }
+    }
 };
 
 namespace sme
@@ -65,3 +127,11 @@ namespace sme
         TRANSITION_TBL_END
     }
 }
+
+namespace sme
+{
+    static const SmEventMask NO_EVENTS = {};
+}
+
+SM_PURE_TABLE(sme::NO_TABLE)
+SM_TABLE_INTEREST(sme::NO_TABLE, sme::NO_EVENTS)
@@ -40,7 +40,13 @@ template <TSmeTable table>
 class GenericStateEngine: public ISmEngine
 {
 public:
-    GenericStateEngine(SmStateInfo *states): ISmEngine(states) { }
+    GenericStateEngine(SmStateInfo *states, int max_queue_size = 10): ISmEngine(states, max_queue_size)
+    {
+        setPure( sme::PureTable<table>::value );
+    }
+
+protected:
+    const SmEventMask *getStateInterest(StateUid sid) override { return sme::TableInterest<table>::get( sid ); }
 
 private:
     STransitionData onEvent(SEventData event) override final { return table( getActiveId(), event); }
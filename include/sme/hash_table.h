@@ -0,0 +1,237 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2020, Aleksei Dynda
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "../sme/dense_table.h"
+
+#if __cplusplus >= 201703L
+
+namespace sme
+{
+    /**
+     * Perfect hash over (source, event, arg) keys of the rows, built at compile time
+     * with hash-and-displace method: keys are split into small buckets, and each bucket
+     * gets the seed, which puts its keys to free slots. Lookup costs two hashes per key
+     * and memory is about one slot per row.
+     */
+    template <const auto &rows>
+    struct HashMatrix
+    {
+        static constexpr size_t ROWS = rowCount( rows );
+        static constexpr uint16_t END = 0xFFFF;
+
+        static_assert( ROWS < END, "transition table is too large for hash matrix" );
+
+        static constexpr bool sameKey(const SmTransitionRow &row, StateUid source, uint8_t event, uintptr_t arg)
+        {
+            return row.source == source && row.event == event && row.arg == arg;
+        }
+
+        static constexpr bool firstKey(size_t r)
+        {
+            for (size_t i = 0; i < r; i++)
+            {
+                if ( sameKey( rows[i], rows[r].source, rows[r].event, rows[r].arg ) ) return false;
+            }
+            return true;
+        }
+
+        static constexpr size_t keyCount()
+        {
+            size_t count = 0;
+            for (size_t r = 0; r < ROWS; r++)
+            {
+                count += firstKey( r ) ? 1 : 0;
+            }
+            return count;
+        }
+
+        static constexpr bool hasAny(bool source)
+        {
+            for (size_t r = 0; r < ROWS; r++)
+            {
+                if ( source ? rows[r].source == SM_STATE_ANY : rows[r].arg == SM_EVENT_ARG_ANY ) return true;
+            }
+            return false;
+        }
+
+        static constexpr size_t KEYS = keyCount();
+        static constexpr size_t BUCKETS = KEYS / 2 + 1;
+        static constexpr size_t SLOTS = KEYS + KEYS / 4 + 1;
+        static constexpr bool ANY_STATE = hasAny( true );
+        static constexpr bool ANY_ARG = hasAny( false );
+
+        static constexpr uint64_t hash(StateUid source, uint8_t event, uintptr_t arg, uint64_t seed)
+        {
+            uint64_t x = (static_cast<uint64_t>( arg ) + seed * 0x9E3779B97F4A7C15ull) ^
+                         ((static_cast<uint64_t>( source ) << 8 | event) << 40);
+            x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+            x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+            return x ^ (x >> 31);
+        }
+
+        static constexpr size_t reduce(uint64_t h, size_t range)
+        {
+            return static_cast<size_t>( ((h >> 32) * range) >> 32 );
+        }
+
+        static constexpr size_t bucket(const SmTransitionRow &row)
+        {
+            return reduce( hash( row.source, row.event, row.arg, 0 ), BUCKETS );
+        }
+
+        static constexpr size_t slot(const SmTransitionRow &row, uint16_t seed)
+        {
+            return reduce( hash( row.source, row.event, row.arg, seed ), SLOTS );
+        }
+
+        struct Data
+        {
+            uint16_t seeds[BUCKETS];
+            uint16_t slots[SLOTS];
+            bool valid;
+        };
+
+        static constexpr bool place(Data &data, const uint16_t *keys, const size_t *buckets, size_t b, uint16_t seed)
+        {
+            for (size_t k = 0; k < KEYS; k++)
+            {
+                if ( buckets[k] != b ) continue;
+                size_t s = slot( rows[keys[k]], seed );
+                if ( data.slots[s] != END ) return false;
+                // Keys of the same bucket must not collide either
+                for (size_t i = 0; i < k; i++)
+                {
+                    if ( buckets[i] == b && slot( rows[keys[i]], seed ) == s ) return false;
+                }
+            }
+            for (size_t k = 0; k < KEYS; k++)
+            {
+                if ( buckets[k] == b )
+                {
+                    data.slots[slot( rows[keys[k]], seed )] = keys[k];
+                }
+            }
+            data.seeds[b] = seed;
+            return true;
+        }
+
+        static constexpr Data build()
+        {
+            Data data{};
+            uint16_t keys[KEYS + 1]{};
+            size_t buckets[KEYS + 1]{};
+            size_t sizes[BUCKETS]{};
+            size_t count = 0;
+            size_t largest = 0;
+            for (size_t s = 0; s < SLOTS; s++)
+            {
+                data.slots[s] = END;
+            }
+            for (size_t r = 0; r < ROWS; r++)
+            {
+                if ( !firstKey( r ) ) continue;
+                keys[count] = static_cast<uint16_t>( r );
+                buckets[count] = bucket( rows[r] );
+                if ( ++sizes[buckets[count]] > largest )
+                {
+                    largest = sizes[buckets[count]];
+                }
+                count++;
+            }
+            // Large buckets are placed first, while there are many free slots
+            for (size_t size = largest; size > 0; size--)
+            {
+                for (size_t b = 0; b < BUCKETS; b++)
+                {
+                    if ( sizes[b] != size ) continue;
+                    uint16_t seed = 1;
+                    while ( !place( data, keys, buckets, b, seed ) )
+                    {
+                        if ( ++seed == END ) return data;
+                    }
+                }
+            }
+            data.valid = true;
+            return data;
+        }
+
+        static constexpr Data data = build();
+
+        static_assert( data.valid, "failed to build perfect hash for transition table" );
+
+        static inline void find(StateUid source, uint8_t event, uintptr_t arg, uint16_t &best)
+        {
+            uint16_t index = data.slots[reduce( hash( source, event, arg, data.seeds[reduce( hash( source, event, arg, 0 ), BUCKETS )] ), SLOTS )];
+            if ( index < best && sameKey( rows[index], source, event, arg ) )
+            {
+                best = index;
+            }
+        }
+    };
+
+    /**
+     * Transition table function, built from the array of SmTransitionRow, for tables with
+     * sparse event ids or arguments, where dense matrix is too large. Up to four keys are
+     * looked up for each event: exact and any argument, in exact and any source state,
+     * and the first row in table order wins, like in macro tables.
+     */
+    template <const auto &rows>
+    STransitionData hashTable(StateUid sid, SEventData event)
+    {
+        using Matrix = HashMatrix<rows>;
+        uint16_t best = Matrix::END;
+        Matrix::find( sid, event.event, event.arg, best );
+        if ( Matrix::ANY_ARG )
+        {
+            Matrix::find( sid, event.event, SM_EVENT_ARG_ANY, best );
+        }
+        if ( Matrix::ANY_STATE )
+        {
+            Matrix::find( SM_STATE_ANY, event.event, event.arg, best );
+            if ( Matrix::ANY_ARG )
+            {
+                Matrix::find( SM_STATE_ANY, event.event, SM_EVENT_ARG_ANY, best );
+            }
+        }
+        if ( best == Matrix::END )
+        {
+            return { EEventResult::NOT_PROCESSED, SM_STATE_NONE };
+        }
+        const SmTransitionRow &row = rows[best];
+        if ( row.func ) row.func();
+        return { row.type, row.dest };
+    }
+}
+
+#endif
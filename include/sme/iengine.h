@@ -36,27 +36,177 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "../sme/state.h"
 #include "../containers/stack.h"
 #include "../containers/list.h"
+#include "../containers/mpsc_queue.h"
+#include "../sme/timer_queue.h"
 
 #if SM_ENGINE_MULTITHREAD
+#include <atomic>
 #include <mutex>
 #include <condition_variable>
+#include <thread>
 #endif
 
 #include <stdint.h>
+#include <stddef.h>
 
 #define SM_FUNC_NONE
 
 #define SM_STATE(state,id) addState<state>(id)
 
+/** Lane, used for the events by default */
+#define SM_LANE_DEFAULT ((SM_ENGINE_PRIORITY_LANES - 1) / 2)
+
+/**
+ * Compact state of the engine, used to hibernate idle engine and to resume it later
+ */
+typedef struct
+{
+    /** Active state id */
+    StateUid active;
+    /** States, stored by pushState(), from the bottom of the stack */
+    sme::vector<StateUid> stack;
+    /** getMicros() timestamp of hibernation */
+    uint64_t timestamp;
+    /** Pending timers, deadlines are relative to the moment of hibernation */
+    sme::vector<SmTimerRecord> timers;
+    /** Generations of timer slots, so handles, issued before hibernation, stay invalid */
+    sme::vector<uint16_t> timerGenerations;
+    /** Pending events */
+    sme::vector<SEventData> events;
+    /** Time in microseconds, the active state has been active till hibernation */
+    uint64_t stateElapsed;
+    /** Time in microseconds left till the active state timeout since hibernation, UINT64_MAX if not armed */
+    uint64_t stateTimeout;
+} SmEngineSnapshot;
+
+class ISmEngine;
+
+/** Function, called when the engine, driven externally, has work to do */
+typedef void (*TSmeNotifyFunction)(ISmEngine *engine, void *arg);
+
+/** Event wait timeout, which makes loop() sleep until the nearest deadline only */
+#define SM_WAIT_FOREVER 0xFFFFFFFF
+
+/**
+ * Defines what the engine does with events, the active state cannot react to
+ */
+enum class EInterestPolicy: uint8_t
+{
+    /** All events are dispatched to the handlers */
+    KEEP,
+    /** update() drops such events without running the handlers */
+    DROP_ON_DISPATCH,
+    /**
+     * sendEvent() drops such events before they take a queue slot, and update()
+     * drops the ones, which became irrelevant while in the queue
+     */
+    DROP_ON_SEND,
+};
+
+/**
+ * Defines how update() drains priority lanes of the event queue
+ */
+enum class ELaneDrainPolicy: uint8_t
+{
+    /** Lower priority lane is served only when all higher priority lanes are empty */
+    STRICT,
+    /** Each lane is served up to its weight events in turn */
+    WEIGHTED,
+};
+
+/**
+ * Defines how the engine waits for new events in multithread mode
+ */
+enum class EWaitStrategy: uint8_t
+{
+    /** Consumer sleeps on condition variable, producers wake it up */
+    BLOCKING,
+    /** Consumer polls the queue until the event or the deadline, occupying the core */
+    BUSY_SPIN,
+    /** Consumer polls the queue for spin count iterations, then yields the core between polls */
+    SPIN_YIELD,
+    /** Consumer polls the queue, then sleeps. Spin budget adapts to the event arrival rate */
+    SPIN_PARK,
+};
+
+/**
+ * Defines what sendEvent() does when the queue lane is full
+ */
+enum class EOverflowPolicy: uint8_t
+{
+    /** New event is rejected */
+    DROP_NEWEST,
+    /** The oldest event in the lane is dropped to make room for the new one */
+    DROP_OLDEST,
+    /** The oldest pending event with the same id is replaced by the new one */
+    OVERWRITE_SAME_ID,
+    /** Producer waits for free room up to the block timeout */
+    BLOCK,
+    /** Lane capacity is doubled up to the lane ceiling */
+    GROW,
+};
+
+/**
+ * Counters of the queue overflow outcomes for single lane
+ */
+typedef struct
+{
+    /** Number of new events, which were rejected */
+    uint32_t rejected;
+    /** Number of old events, dropped to make room for new ones */
+    uint32_t evicted;
+    /** Number of pending events, replaced by new ones with the same id */
+    uint32_t overwritten;
+    /** Number of times producers waited for free room */
+    uint32_t blocked;
+    /** Number of rejected events, which waited for block timeout in vain */
+    uint32_t timedOut;
+    /** Number of times lane capacity was increased */
+    uint32_t grown;
+} SmQueueStats;
+
+/**
+ * Counters of transition cache lookups, see ISmEngine::setTransitionCache()
+ */
+typedef struct
+{
+    uint32_t hits;
+    uint32_t misses;
+} SmCacheStats;
+
+/**
+ * Defines how the engine filters incoming events with the same id
+ */
+enum class EEventFilter: uint8_t
+{
+    /** All events are dispatched */
+    NONE,
+    /** First event is dispatched, next ones are dropped until the id is quiet for the interval */
+    DEBOUNCE_LEADING,
+    /** Only last event is dispatched, after the id is quiet for the interval */
+    DEBOUNCE_TRAILING,
+    /** At most one event is dispatched per interval, others are dropped */
+    THROTTLE,
+};
+
 class ISmEngine: public ISmeState
 {
 public:
 
+    /**
+     * Creates engine for the list of states.
+     *
+     * @param states list of states, terminated with STATE_LIST_END
+     * @param max_queue_size capacity of the event queue, used by SM_LANE_DEFAULT.
+     *        Other priority lanes are enabled by setLaneCapacity().
+     */
     ISmEngine(const SmStateInfo *states, int max_queue_size = 10)
         : ISmeState( "engine" )
         , m_max_event_queue_size( max_queue_size )
         , m_states( states )
     {
+        m_lanes[SM_LANE_DEFAULT].queue.reset( max_queue_size );
+        m_lanes[SM_LANE_DEFAULT].enabled = true;
     }
 
     ~ISmEngine();
@@ -79,21 +229,146 @@ public:
      * Enters infinite loop and runs state machine. If you want
      * to do anything else outside state machine functions, please,
      * do not use this function. Refer to run() function instead.
+     * The loop is tickless: it sleeps until new event arrives, or until the nearest
+     * deferred event or the timeout, polled by active state via timeoutEvent().
      *
-     * @param eventWaitTimeoutMs timeout to wait for incoming event. Do not use 0,
-     *        since loop() will occupy 100% cpu.
+     * @param eventWaitTimeoutMs maximum time between state update() calls. Do not use 0,
+     *        since loop() will occupy 100% cpu. SM_WAIT_FOREVER means that update()
+     *        is called only on events and deadlines.
      */
-    void loop(uint32_t eventWaitTimeoutMs);
+    void loop(uint32_t eventWaitTimeoutMs = SM_WAIT_FOREVER);
 
     /**
      * @brief sets event wait timeout
      *
-     * If no events in state machine engine queue, then sme will wait for specified time
+     * If no events in state machine engine queue, then sme will wait for specified time,
+     * but not longer than until the nearest deadline.
      *
-     * @param eventWaitTimeoutMs event timeout in milliseconds
+     * @param eventWaitTimeoutMs event timeout in milliseconds, SM_WAIT_FOREVER to wait
+     *        for the events and deadlines only
      */
     void setWaitEventTimeout( uint32_t eventWaitTimeoutMs ) { m_eventWaitTimeoutMs = eventWaitTimeoutMs; }
 
+    /**
+     * @brief selects how the engine waits for new events
+     *
+     * Spinning strategies avoid the cost of waking up sleeping thread, but
+     * occupy the core. Use them only if the engine thread has dedicated core.
+     *
+     * @param strategy wait strategy
+     * @param spinCount number of queue polls before yielding or sleeping. For
+     *        EWaitStrategy::SPIN_PARK it is the upper limit of adaptive spin budget.
+     */
+    void setWaitStrategy( EWaitStrategy strategy, uint32_t spinCount = 4096 );
+
+    /**
+     * @brief creates pollable handles to drive the engine from external event loop
+     *
+     * After the call, the engine signals eventfd, returned by getEventFd(), when
+     * new event arrives, and arms timerfd, returned by getTimerFd(), for the
+     * nearest deadline. Add both descriptors to epoll or poll set, and call
+     * processReady() when any of them becomes readable. update() and loop() do not
+     * wait for the events after the call. Must be called before begin().
+     * Available on Linux only.
+     *
+     * @return false if pollable handles are not supported or cannot be created
+     */
+    bool enablePollFds();
+
+    /**
+     * @brief sets function, called when the engine needs processReady() call
+     *
+     * The notifier is called by producer threads, when new event arrives, or new
+     * timer moves the nearest deadline, while the engine is not processing events.
+     * It allows executors to schedule the engine only when it has work. Must be
+     * called before begin(). In single thread mode the notifier is called for every
+     * new event and deadline change, including the ones made during processing.
+     *
+     * @param func notifier function, nullptr to remove the notifier
+     * @param arg argument, passed to the notifier
+     */
+    void setNotifier(TSmeNotifyFunction func, void *arg);
+
+    /**
+     * Returns the nearest time in getMicros() units, when the engine needs processReady()
+     * call without new events, or UINT64_MAX if there are no deadlines
+     */
+    uint64_t getNextDeadline();
+
+    /**
+     * Returns eventfd, which becomes readable when new events arrive, or -1
+     */
+    int getEventFd() const { return m_eventFd; }
+
+    /**
+     * Returns timerfd, which becomes readable at the nearest deadline, or -1
+     */
+    int getTimerFd() const { return m_timerFd; }
+
+    /**
+     * @brief moves the engine state to compact snapshot
+     *
+     * Saves active state, state stack, pending timers and pending events. The event
+     * queue and the timers are cleared, exit() of the active state is not called.
+     * Shared states are released as by end(). After the call the engine can be
+     * destroyed without end() call.
+     *
+     * @param snapshot snapshot to fill
+     */
+    void hibernate(SmEngineSnapshot &snapshot);
+
+    /**
+     * @brief restores the engine state from the snapshot
+     *
+     * The engine must be started with begin() without initial state. enter() of
+     * the active state is not called. Timers are restarted with new handles, the time
+     * passed since hibernation is taken into account.
+     *
+     * @param snapshot snapshot, created by hibernate()
+     * @return false if snapshot refers to unknown state
+     */
+    bool resume(const SmEngineSnapshot &snapshot);
+
+    /**
+     * @brief sets per-engine data
+     *
+     * States, shared by several engines, keep per-engine data in the context
+     * and access it via ISmeState::getContext().
+     *
+     * @param context pointer to user data
+     */
+    void setContext(void *context) { m_context = context; }
+
+    /**
+     * Returns per-engine data, set by setContext()
+     */
+    void *getContext() override final { return m_context; }
+
+    /**
+     * Returns true if there are events in the queue
+     */
+    bool hasPendingEvents() { return hasEvents(); }
+
+    /**
+     * @brief processes ready events and timers without blocking
+     *
+     * Works as update(), but never waits for the events. If pollable handles are
+     * enabled, it clears them and rearms timerfd for the next deadline.
+     */
+    void processReady();
+
+    /**
+     * @brief limits number of events, processed by single update() call
+     *
+     * update() drains only events, which are ready when it starts: events, sent
+     * by the handlers during the drain, are processed on next update() call.
+     * The batch size additionally limits the number of dispatched events,
+     * so state update() is not starved under heavy load.
+     *
+     * @param maxBatchSize maximum number of events per update() call, 0 means no limit
+     */
+    void setMaxBatchSize( int maxBatchSize ) { m_maxBatchSize = maxBatchSize; }
+
     /**
      * @brief Runs single iteration of state machine.
      *
@@ -107,29 +382,213 @@ public:
     /**
      * @brief sends event state machine event queue
      *
-     * Sends event to state machine event queue
+     * Sends event to state machine event queue. The method is lock-free and
+     * can be called from any thread.
      *
      * @param event event to put to queue
+     * @return false if the queue is full, or the event is dropped by the interest policy
      */
     bool sendEvent(SEventData event) override final;
 
+    /**
+     * @brief sends several events to state machine event queue at once
+     *
+     * Puts events to the queue, claiming free slots in bulk, and wakes up
+     * the engine only once. Events are put in order until the queue is full.
+     *
+     * @param events pointer to the array of events
+     * @param count number of events in the array
+     * @return number of events taken from the array: put to the queue, or dropped
+     *         by the interest policy
+     */
+    size_t sendEvents(const SEventData *events, size_t count);
+
+    /**
+     * @brief sends event to the specified priority lane of the event queue
+     *
+     * @param event event to put to queue
+     * @param lane priority lane, 0 is the highest priority. The events for the lane,
+     *        not enabled by setLaneCapacity(), go to SM_LANE_DEFAULT.
+     * @return false if the lane is full, or the event is dropped by the interest policy
+     */
+    bool sendPriorityEvent(SEventData event, uint8_t lane);
+
+    /**
+     * @brief assigns priority lane to the event id
+     *
+     * sendEvent() puts the events with specified id to the lane. By default,
+     * SM_EVENT_TIMEOUT goes to lane 0, all other events go to SM_LANE_DEFAULT.
+     * Only SM_LANE_DEFAULT is enabled by default, the events for other lanes
+     * go to it, until the lane is enabled by setLaneCapacity().
+     *
+     * @param eventId event id
+     * @param lane priority lane, 0 is the highest priority
+     */
+    void setEventPriority(uint8_t eventId, uint8_t lane);
+
+    /**
+     * @brief changes capacity of the priority lane and enables it
+     *
+     * Must be called before begin(), when no events are in the lane.
+     *
+     * @param lane priority lane
+     * @param capacity maximum number of pending events in the lane
+     * @param ceiling maximum capacity for EOverflowPolicy::GROW. Memory is allocated
+     *        for the ceiling at once, so the lane never reallocates.
+     */
+    void setLaneCapacity(uint8_t lane, int capacity, int ceiling = 0);
+
+    /**
+     * @brief sets what sendEvent() does when the queue lane is full
+     *
+     * EOverflowPolicy::BLOCK is available only in multithread mode, and
+     * producers never block when called from update() thread.
+     *
+     * @param policy overflow policy
+     * @param blockTimeoutMs maximum time producer waits for EOverflowPolicy::BLOCK
+     */
+    void setOverflowPolicy(EOverflowPolicy policy, uint32_t blockTimeoutMs = 0);
+
+    /**
+     * Sets number of events, served from the lane in turn, for ELaneDrainPolicy::WEIGHTED
+     */
+    void setLaneWeight(uint8_t lane, uint8_t weight);
+
+    /**
+     * Sets the order, in which update() serves priority lanes
+     */
+    void setLaneDrainPolicy(ELaneDrainPolicy policy) { m_drainPolicy = policy; }
+
+    /**
+     * Returns number of events, lost because the lane was full: rejected and evicted ones
+     */
+    uint32_t getDroppedEvents(uint8_t lane);
+
+    /**
+     * Returns counters of the queue overflow outcomes for the lane
+     */
+    SmQueueStats getQueueStats(uint8_t lane);
+
+    /**
+     * @brief sets what to do with events, the active state cannot react to
+     *
+     * The event is relevant, if it is in the event interest of the engine or of
+     * the active state (see ISmeState::setEventInterest()). Engines and states
+     * without event interest are treated as interested in any event.
+     *
+     * @param policy interest policy, EInterestPolicy::KEEP by default
+     */
+    void setInterestPolicy(EInterestPolicy policy) { m_interestPolicy = policy; }
+
+    /**
+     * Returns number of events, dropped according to the interest policy
+     */
+    uint32_t getUninterestedEvents() { return m_uninterested; }
+
+    /**
+     * @brief enables cache of transition results
+     *
+     * If the engine and the active state are marked pure (see ISmeState::setPure()
+     * and SM_PURE_TABLE()), results of their onEvent() methods are stored to
+     * direct-mapped cache, keyed by active state id, event id and argument, and
+     * next events with the same key do not run transition tables at all.
+     *
+     * @param size number of cache entries, rounded up to the power of two. 0 disables the cache
+     */
+    void setTransitionCache(int size);
+
+    /**
+     * Returns counters of transition cache lookups
+     */
+    SmCacheStats getTransitionCacheStats() { return { m_cacheHits, m_cacheMisses }; }
+
+    /**
+     * @brief enables latest-value coalescing for the event id
+     *
+     * Only one event with coalesced id can be pending in the queue. New event
+     * with the same id replaces the argument of the pending one in place, so
+     * the handler receives the latest value, and queue depth is bounded by
+     * the number of distinct ids rather than by the input rate.
+     * Must be called before any events are sent. The table of coalesced events
+     * is allocated on the heap by the first call.
+     *
+     * @param eventId event id
+     * @param enable true to enable coalescing, false to disable
+     * @return true if the setting is applied
+     */
+    bool setEventCoalescing(uint8_t eventId, bool enable);
+
+    /**
+     * @brief sets debounce or throttle filter for the event id
+     *
+     * The filter is applied to the events from the queue before they reach
+     * processAppEvent(). Trailing debounce postpones the event using engine
+     * timers; deferred events, sent with sendEvent(event, ms), are not filtered.
+     * Must be called before begin(). The table of filters is allocated on the
+     * heap by the first call.
+     *
+     * @param eventId event id
+     * @param filter filter type, EEventFilter::NONE disables filtering
+     * @param intervalMs debounce or throttle interval in milliseconds
+     * @return true if the setting is applied
+     */
+    bool setEventFilter(uint8_t eventId, EEventFilter filter, uint32_t intervalMs);
+
     /**
      * @brief sends event state machine event queue after ms timeout
      *
-     * Sends event to state machine event queue after ms timeout
+     * Sends event to state machine event queue after ms timeout. Deferred events
+     * are kept in the timer queue with absolute 64-bit deadlines, and update()
+     * touches only the timers, which are due.
      *
      * @param event event to put to queue
      * @param ms timeout in milliseconds
+     * @return timer handle or SM_TIMER_INVALID if the timer queue is full
+     */
+    SmTimerHandle sendEvent(SEventData event, uint32_t ms)
+    {
+        return startTimer( event, ms, 0, ETimerPolicy::SKIP, nullptr );
+    }
+
+    /**
+     * @brief sends event to state machine event queue every periodMs milliseconds
+     *
+     * Starts periodic timer. Ticks are scheduled on absolute cadence, so the timer
+     * does not drift because of processing latency. Periodic timer lives in the
+     * same timer queue as deferred events and costs nothing between its deadlines.
+     *
+     * @param event event to put to queue
+     * @param periodMs period in milliseconds
+     * @param policy defines how ticks, missed because engine was busy, are handled
+     * @return timer handle, which must be used to stop the timer via cancel()
+     */
+    SmTimerHandle sendPeriodicEvent(SEventData event, uint32_t periodMs, ETimerPolicy policy = ETimerPolicy::SKIP)
+    {
+        return startTimer( event, periodMs, periodMs, policy, nullptr );
+    }
+
+    /**
+     * Cancels deferred event, sent with sendEvent(event, ms). The method takes O(1).
+     * Returns false if the event is already fired or cancelled.
      */
-    bool sendEvent(SEventData event, uint32_t ms);
+    bool cancel(SmTimerHandle handle) override final;
+
+    /**
+     * @brief enables automatic cancellation of state timers
+     *
+     * If enabled, all deferred events, sent by active state via its own
+     * sendEvent(event, ms) method, are cancelled when the state exits.
+     */
+    void setCancelTimersOnExit(bool enable) { m_cancelTimersOnExit = enable; }
 
     /**
      * Terminates state machine. This causes loop() method to exit.
      */
-    void stop() { m_stopped = true; }
+    void stop() { m_stopped = true; wakeUp(); }
 
     /**
-     * Returns timestamp in microseconds
+     * Returns monotonic timestamp in microseconds. Override it on platforms
+     * without std::chrono support.
      */
     virtual uint64_t getMicros();
 
@@ -146,7 +605,8 @@ public:
     void resetTimeout() override final;
 
     /**
-     * Returns pointer to state object by id
+     * Returns pointer to state object by id. After begin(), the lookup is
+     * a single indexed load if SM_ENGINE_STATE_INDEX is enabled.
      */
     ISmeState *getById(StateUid id);
 
@@ -176,34 +636,229 @@ protected:
      */
     virtual void onEnd();
 
-    void setStates( const SmStateInfo *states ) { m_states = states; }
+    /**
+     * Returns event ids, which onEvent() of the engine can process, when the state
+     * is active, or nullptr for any event. By default returns the engine event interest.
+     */
+    virtual const SmEventMask *getStateInterest(StateUid /*sid*/) { return getEventInterest(); }
+
+    void setStates( const SmStateInfo *states ) { m_states = states; dropStateIndex(); }
+
+    SmTimerHandle startTimer(SEventData event, uint32_t ms, uint32_t periodMs,
+                             ETimerPolicy policy, ISmeState *owner) override final;
 
 private:
     ISmeState *m_active = nullptr;
 
 #if SM_ENGINE_MULTITHREAD
+    // m_mutex is used only to put consumer to sleep, the event queue is lock-free
     std::condition_variable m_cond{};
     std::mutex m_mutex{};
+    std::atomic<bool> m_waiting{false};
+    // Producers, waiting for free room with EOverflowPolicy::BLOCK
+    std::condition_variable m_spaceCond{};
+    std::atomic<int> m_blockedProducers{0};
+    std::atomic<std::thread::id> m_consumerThread{};
+    EWaitStrategy m_waitStrategy = EWaitStrategy::BLOCKING;
+    uint32_t m_spinCount = 4096;
+    uint32_t m_spinBudget = 4096;
+    std::mutex m_timerMutex{};
+    // Copy of the nearest timer deadline, allows to skip locking m_timerMutex
+    std::atomic<uint64_t> m_nextDeadline{UINT64_MAX};
+    std::atomic<bool> m_stopped{false};
+    // Event interest of active state and of the engine in it, read by producers
+    std::atomic<const SmEventMask *> m_activeInterest{nullptr};
+    std::atomic<const SmEventMask *> m_engineInterest{nullptr};
+    std::atomic<uint32_t> m_uninterested{0};
+#else
+    uint64_t m_nextDeadline = UINT64_MAX;
+    bool m_stopped = false;
+    const SmEventMask *m_activeInterest = nullptr;
+    const SmEventMask *m_engineInterest = nullptr;
+    uint32_t m_uninterested = 0;
+#endif
+#if SM_ENGINE_POLL_FD
+    int m_eventFd = -1;
+    int m_timerFd = -1;
+#else
+    static constexpr int m_eventFd = -1;
+    static constexpr int m_timerFd = -1;
 #endif
 
     int m_max_event_queue_size = 10;
+    int m_maxBatchSize = 0;
+
+    struct Lane
+    {
+        sme::mpsc_queue<SEventData> queue{};
+#if SM_ENGINE_MULTITHREAD
+        typedef std::atomic<uint32_t> counter;
+#else
+        typedef uint32_t counter;
+#endif
+        counter rejected{0};
+        counter evicted{0};
+        counter overwritten{0};
+        counter blocked{0};
+        counter timedOut{0};
+        counter grown{0};
+        uint8_t weight = 1;
+        // The lane has own capacity, otherwise its events go to SM_LANE_DEFAULT
+        bool enabled = false;
+    };
 
     sme::stack<ISmeState*> m_stack{};
-    sme::list<__SDeferredEventData> m_events{};
+    Lane m_lanes[SM_ENGINE_PRIORITY_LANES];
+#if SM_ENGINE_PRIORITY_LANES > 1
+    // Lanes by event id, allocated by the first setEventPriority() call
+    uint8_t *m_eventLane = nullptr;
+#endif
+    // Latest value slots for coalesced events, indexed by event id
+    enum
+    {
+        COALESCE_IDLE,
+        // The producer puts the event to the lane, other producers wait for the result
+        COALESCE_RESERVING,
+        COALESCE_QUEUED,
+    };
+    struct CoalescedEvent
+    {
+#if SM_ENGINE_MULTITHREAD
+        std::atomic<uintptr_t> arg{0};
+        std::atomic<uint8_t> state{COALESCE_IDLE};
+#else
+        uintptr_t arg = 0;
+        uint8_t state = COALESCE_IDLE;
+#endif
+    };
+    // Allocated by the first setEventCoalescing() call
+    struct CoalesceTable
+    {
+        uint32_t mask[8] = {};
+        CoalescedEvent slots[256];
+    };
+    CoalesceTable *m_coalesced = nullptr;
+    // Debounce and throttle state, indexed by event id. Accessed by consumer only
+    struct EventFilter
+    {
+        uint64_t last = 0;
+        uint64_t interval = 0;
+        SmTimerHandle timer = SM_TIMER_INVALID;
+        EEventFilter type = EEventFilter::NONE;
+        bool seen = false;
+    };
+    // Allocated by the first setEventFilter() call
+    struct FilterTable
+    {
+        uint32_t mask[8] = {};
+        EventFilter filters[256];
+    };
+    FilterTable *m_filters = nullptr;
+    // Results of pure transition tables. Accessed by consumer only
+    struct CachedTransition
+    {
+        uintptr_t arg;
+        StateUid state;
+        uint8_t event;
+        bool valid;
+        STransitionData result;
+    };
+    CachedTransition *m_cache = nullptr;
+    uint32_t m_cacheMask = 0;
+    uint32_t m_cacheHits = 0;
+    uint32_t m_cacheMisses = 0;
+    ELaneDrainPolicy m_drainPolicy = ELaneDrainPolicy::STRICT;
+    EOverflowPolicy m_overflowPolicy = EOverflowPolicy::DROP_NEWEST;
+    EInterestPolicy m_interestPolicy = EInterestPolicy::KEEP;
+    uint32_t m_blockTimeoutMs = 0;
+    SmTimerQueue m_timers{};
     const SmStateInfo *m_states = nullptr;
+#if SM_ENGINE_STATE_INDEX
+    // States by id, built by begin() from m_states
+    ISmeState **m_stateIndex = nullptr;
+    int m_stateIndexSize = 0;
+#endif
 
-    bool m_stopped = false;
-    uint32_t m_lastUpdateTimeMs = 0;
+    bool m_cancelTimersOnExit = false;
+    // The engine is driven by external loop via processReady()
+    bool m_external = false;
+    TSmeNotifyFunction m_notifier = nullptr;
+    void *m_notifierArg = nullptr;
+    void *m_context = nullptr;
+
+    // Makes the engine current for its states, while it calls their methods
+    struct CurrentScope
+    {
+        explicit CurrentScope(ISmEngine *engine): previous( current() ) { current() = engine; }
+        ~CurrentScope() { current() = previous; }
+        ISmeState *previous;
+    };
     uint64_t m_stateStartTs = 0;
+    // The nearest timeout, polled by active state via timeoutEvent()
+    uint64_t m_stateDeadline = UINT64_MAX;
+    // Timer of active state timeout, see ISmeState::setTimeout()
+    SmTimerHandle m_stateTimer = SM_TIMER_INVALID;
     uint32_t m_eventWaitTimeoutMs = 0;
     StateUid m_activeId = SM_STATE_NONE;
 
     EEventResult processAppEvent(SEventData &event);
 
+    STransitionData findTransition(SEventData event);
+
+    bool isInterested(uint8_t eventId);
+
+    bool dropOnSend(uint8_t eventId);
+
     void registerState(ISmeState &state, bool autoAllocated);
 
     void waitForNextEvent();
 
+    void dispatchEvents();
+
+    void signal();
+
+    void sleepExternally();
+
+    bool spinForNextEvent(uint64_t deadline, uint32_t spins, bool yield);
+
+    void wakeUp();
+
+    bool hasEvents();
+
+    uint8_t getEventLane(uint8_t eventId);
+
+    bool isCoalesced(uint8_t eventId)
+    {
+        return m_coalesced != nullptr && (m_coalesced->mask[eventId >> 5] & (1UL << (eventId & 31)));
+    }
+
+    bool pushEvent(SEventData event, uint8_t lane);
+
+    bool pushCoalesced(SEventData event, uint8_t lane);
+
+    bool pushLane(Lane &lane, SEventData event);
+
+    bool waitForSpace(Lane &lane, SEventData event);
+
+    void notifySpace();
+
+    void takeCoalesced(SEventData &event);
+
+    bool isFiltered(uint8_t eventId)
+    {
+        return m_filters != nullptr && (m_filters->mask[eventId >> 5] & (1UL << (eventId & 31)));
+    }
+
+    bool filterEvent(SEventData event, uint64_t now);
+
+    int nextLane(int *ready, int *credit);
+
+    bool popExpiredTimer(uint64_t now, SEventData &event);
+
+    void armStateTimeout();
+
+    void cancelStateTimeout();
+
     /**
      * @brief change current state to new one
      *
@@ -214,6 +869,15 @@ private:
      */
     bool switchState(StateUid newState, SEventData *event);
 
+    /**
+     * Changes current state to already resolved state object
+     */
+    bool switchState(ISmeState *newState, SEventData *event);
+
+    void buildStateIndex();
+
+    void dropStateIndex();
+
     /**
      * @brief change current state to new one, but stores current state
      *
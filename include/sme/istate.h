@@ -38,6 +38,10 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "../sme/transition.h"
 #include <stdint.h>
 
+#if SM_ENGINE_MULTITHREAD
+#include <atomic>
+#endif
+
 class ISmeState;
 
 typedef struct
@@ -102,10 +106,120 @@ public:
     /**
      * Sets state id. Id is changed only if it was not previously specified for the state.
      */
-    void setId(StateUid id) { if ( m_id == SM_STATE_NONE ) m_id = id; }
+    void setId(StateUid id)
+    {
+        if ( m_id == SM_STATE_NONE )
+        {
+            m_id = id;
+            onSetId();
+        }
+    }
 
     void setParent( ISmeState * parent ) { m_parent = parent; }
 
+    /**
+     * @brief marks the state as shared by several engines
+     *
+     * Shared state is not bound to single engine: sendEvent(), timers and
+     * timeouts are routed to the engine, which calls the state methods in this
+     * thread right now. The same state objects and SmStateInfo table can be used
+     * by any number of engines, per-engine data is available via getContext().
+     *
+     * The engine is known only inside begin(), end(), update() and event
+     * processing. Code, running outside of them, must call the engine directly.
+     * begin() and end() of shared state are called once: by the first engine,
+     * which starts, and by the last engine, which stops or hibernates. Engines
+     * never delete shared states.
+     *
+     * @param shared true if the state is shared
+     */
+    void setShared(bool shared) { m_shared = shared; }
+
+    /**
+     * Returns true if the state is shared by several engines
+     */
+    bool isShared() const { return m_shared; }
+
+    /**
+     * Returns true if the engine owns the state: the state is not shared and is
+     * added to that engine
+     */
+    bool isOwnedBy(const ISmeState *engine) const { return !m_shared && m_parent == engine; }
+
+    /**
+     * Registers one more engine, running the shared state. Returns true for the
+     * first engine, which must call begin()
+     */
+    bool addUser() { return m_users++ == 0; }
+
+    /**
+     * Unregisters the engine, running the shared state. Returns true for the
+     * last engine, which must call end()
+     */
+    bool removeUser() { return --m_users == 0; }
+
+    /**
+     * @brief marks onEvent() of the state as pure
+     *
+     * Result of pure onEvent() depends only on state id, event id and argument,
+     * and the method has no side effects. The engine can cache such results,
+     * see ISmEngine::setTransitionCache().
+     *
+     * @param pure true if onEvent() is pure
+     */
+    void setPure(bool pure) { m_pure = pure; }
+
+    /**
+     * Returns true if onEvent() of the state is pure
+     */
+    bool isPure() { return m_pure; }
+
+    /**
+     * @brief sets event ids, which onEvent() of the state can process
+     *
+     * The engine uses the mask to skip events, the active state cannot react to,
+     * see ISmEngine::setInterestPolicy(). The mask must stay valid while the state
+     * is used.
+     *
+     * @param mask event ids, or nullptr if the state can process any event
+     */
+    void setEventInterest(const SmEventMask *mask) { m_interest = mask; }
+
+    /**
+     * Returns event ids, which the state can process, or nullptr for any event
+     */
+    const SmEventMask *getEventInterest() { return m_interest; }
+
+    /**
+     * @brief returns per-engine data of the engine, running the state
+     *
+     * @see ISmEngine::setContext()
+     */
+    virtual void *getContext() { return parent() ? parent()->getContext() : nullptr; }
+
+    /**
+     * Returns per-engine data of the engine, running the state, casted to T
+     */
+    template <typename T>
+    T *getContext() { return static_cast<T *>( getContext() ); }
+
+    /**
+     * @brief sets state timeout
+     *
+     * State machine engine sends SM_EVENT_TIMEOUT, when the state stays active
+     * for ms milliseconds. The timeout is armed by the engine timer after the state
+     * enter() and is cancelled on state exit(), so it fires exactly once without polling.
+     * The event argument is the timeout in microseconds, the same as for timeoutEvent().
+     *
+     * @param ms timeout in milliseconds, 0 disables the timeout
+     */
+    void setTimeout(uint32_t ms) { m_timeoutMs = ms; }
+
+    /**
+     * Returns state timeout in milliseconds, 0 if the state has no timeout
+     */
+    uint32_t getTimeout() { return m_timeoutMs; }
+
 protected:
 
     /**
@@ -115,7 +229,55 @@ protected:
      *
      * @param event event to put to queue
      */
-    virtual bool sendEvent(SEventData event) { return m_parent ? m_parent->sendEvent( event ) : false; }
+    virtual bool sendEvent(SEventData event) { return parent() ? parent()->sendEvent( event ) : false; }
+
+    /**
+     * @brief sends event to state machine event queue after ms timeout
+     *
+     * Sends event to state machine event queue after ms timeout. The timer is
+     * owned by the state: if state machine engine is configured to cancel timers
+     * on state exit, the timer is cancelled, when the state is deactivated.
+     *
+     * @param event event to put to queue
+     * @param ms timeout in milliseconds
+     * @return timer handle, which can be used to cancel the timer
+     */
+    SmTimerHandle sendEvent(SEventData event, uint32_t ms)
+    {
+        return startTimer( event, ms, 0, ETimerPolicy::SKIP, this );
+    }
+
+    /**
+     * @brief sends event to state machine event queue every periodMs milliseconds
+     *
+     * Starts periodic timer, owned by the state. Ticks follow absolute cadence
+     * and do not drift with event processing latency.
+     *
+     * @param event event to put to queue
+     * @param periodMs period in milliseconds
+     * @param policy defines how missed ticks are handled
+     * @return timer handle, which can be used to cancel the timer
+     */
+    SmTimerHandle sendPeriodicEvent(SEventData event, uint32_t periodMs, ETimerPolicy policy = ETimerPolicy::SKIP)
+    {
+        return startTimer( event, periodMs, periodMs, policy, this );
+    }
+
+    /**
+     * Cancels timer, started with sendEvent(event, ms).
+     * Returns false if the timer is already fired or cancelled.
+     */
+    virtual bool cancel(SmTimerHandle handle) { return parent() ? parent()->cancel( handle ) : false; }
+
+    /**
+     * Starts timer, owned by specified state. The first tick happens after ms timeout,
+     * if periodMs is not 0, the timer is restarted every periodMs milliseconds.
+     */
+    virtual SmTimerHandle startTimer(SEventData event, uint32_t ms, uint32_t periodMs,
+                                     ETimerPolicy policy, ISmeState *owner)
+    {
+        return parent() ? parent()->startTimer( event, ms, periodMs, policy, owner ) : SM_TIMER_INVALID;
+    }
 
     /**
      * Returns timestamp in microseconds, since system is up
@@ -131,13 +293,37 @@ protected:
      */
     virtual bool timeoutEvent(uint64_t timeout, bool generate_event = false)
     {
-        return m_parent ? m_parent->timeoutEvent( timeout, generate_event ) : false;
+        return parent() ? parent()->timeoutEvent( timeout, generate_event ) : false;
     }
 
     /**
-     * Resets internal state timer
+     * Resets internal state timer and restarts the state timeout, if any
+     */
+    virtual void resetTimeout() { if ( parent() ) parent()->resetTimeout(); }
+
+    /**
+     * Is called once, when the state gets its id
+     */
+    virtual void onSetId() { }
+
+    /**
+     * Returns engine, which runs the state: the parent, or the current engine for
+     * shared state or state without parent
      */
-    virtual void resetTimeout() { if (m_parent) m_parent->resetTimeout(); }
+    ISmeState *parent() { return m_shared || m_parent == nullptr ? current() : m_parent; }
+
+    /**
+     * Returns engine, which calls state methods in this thread right now
+     */
+    static ISmeState *&current()
+    {
+#if SM_ENGINE_MULTITHREAD
+        static thread_local ISmeState *engine = nullptr;
+#else
+        static ISmeState *engine = nullptr;
+#endif
+        return engine;
+    }
 
 private:
 
@@ -146,5 +332,19 @@ private:
     const char * m_name = nullptr;
 
     ISmeState * m_parent = nullptr;
+
+    uint32_t m_timeoutMs = 0;
+
+    bool m_shared = false;
+
+#if SM_ENGINE_MULTITHREAD
+    std::atomic<uint16_t> m_users{0};
+#else
+    uint16_t m_users = 0;
+#endif
+
+    bool m_pure = false;
+
+    const SmEventMask *m_interest = nullptr;
 };
 
@@ -0,0 +1,241 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2020, Aleksei Dynda
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "../sme/dense_table.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define SM_SCAN_AVX2 1
+#include <immintrin.h>
+#else
+#define SM_SCAN_AVX2 0
+#endif
+
+/**
+ * Transition rows, stored as separate arrays of sources, event ids and arguments.
+ * Byte arrays are aligned and padded to 32 rows.
+ */
+typedef struct
+{
+    const uint8_t *sources;
+    const uint8_t *events;
+    /** Hashes of arguments, to compare them in the same pass as event ids */
+    const uint8_t *argTags;
+    const uintptr_t *args;
+    /** Bit per row, set if the row accepts any argument */
+    const uint32_t *anyArg;
+    int count;
+} SmRowScan;
+
+namespace sme
+{
+    constexpr uint8_t argTag(uintptr_t arg)
+    {
+        return static_cast<uint8_t>( (static_cast<uint64_t>( arg ) * 0x9E3779B97F4A7C15ull) >> 56 );
+    }
+
+    /**
+     * Returns index of the first row, which matches the event in the state, or -1.
+     * Uses AVX2 compares of 32 rows at once, if the cpu supports them.
+     */
+    int scanRows(const SmRowScan &scan, StateUid sid, SEventData event);
+
+    /** True if the cpu supports AVX2 and BMI1, resolved once at program start */
+    extern const bool scanHasAvx2;
+}
+
+#if __cplusplus >= 201703L
+
+namespace sme
+{
+    template <const auto &rows>
+    struct ScanRows
+    {
+        static constexpr size_t ROWS = rowCount( rows );
+        static constexpr size_t SIZE = (ROWS + 31) / 32 * 32;
+
+        struct Data
+        {
+            alignas(32) uint8_t sources[SIZE];
+            alignas(32) uint8_t events[SIZE];
+            alignas(32) uint8_t argTags[SIZE];
+            uintptr_t args[SIZE];
+            uint32_t anyArg[SIZE / 32];
+        };
+
+        static constexpr Data build()
+        {
+            Data data{};
+            for (size_t r = 0; r < ROWS; r++)
+            {
+                data.sources[r] = rows[r].source;
+                data.events[r] = rows[r].event;
+                data.argTags[r] = argTag( rows[r].arg );
+                data.args[r] = rows[r].arg;
+                if ( rows[r].arg == SM_EVENT_ARG_ANY )
+                {
+                    data.anyArg[r / 32] |= 1u << (r % 32);
+                }
+            }
+            return data;
+        }
+
+        static constexpr Data data = build();
+
+        static constexpr bool anySource()
+        {
+            for (size_t r = 0; r < ROWS; r++)
+            {
+                if ( rows[r].source != SM_STATE_ANY )
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        /** Rows, applied in any state, do not need compares of the sources */
+        static constexpr bool ANY_SOURCE = anySource();
+        static constexpr SmRowScan scan = { data.sources, data.events, data.argTags, data.args, data.anyArg, static_cast<int>( ROWS ) };
+
+        static bool argMatches(size_t index, uintptr_t arg)
+        {
+            return ((data.anyArg[index / 32] >> (index % 32)) & 1) || data.args[index] == arg;
+        }
+
+#if SM_SCAN_AVX2
+        __attribute__((target("avx2")))
+        static uint32_t blockMask(size_t b, __m256i eventId, __m256i state, __m256i tag)
+        {
+            __m256i events = _mm256_load_si256( reinterpret_cast<const __m256i *>( data.events + b * 32 ) );
+            __m256i tags = _mm256_load_si256( reinterpret_cast<const __m256i *>( data.argTags + b * 32 ) );
+            __m256i match = _mm256_cmpeq_epi8( events, eventId );
+            if ( !ANY_SOURCE )
+            {
+                __m256i sources = _mm256_load_si256( reinterpret_cast<const __m256i *>( data.sources + b * 32 ) );
+                __m256i any = _mm256_set1_epi8( static_cast<char>( SM_STATE_ANY ) );
+                match = _mm256_and_si256( match, _mm256_or_si256( _mm256_cmpeq_epi8( sources, state ),
+                                                                  _mm256_cmpeq_epi8( sources, any ) ) );
+            }
+            // Rows with any argument or with the same argument hash
+            uint32_t mask = static_cast<uint32_t>( _mm256_movemask_epi8( match ) ) &
+                            ( static_cast<uint32_t>( _mm256_movemask_epi8( _mm256_cmpeq_epi8( tags, tag ) ) ) | data.anyArg[b] );
+            // Padding rows of the last block
+            if ( b == SIZE / 32 - 1 && ROWS % 32 )
+            {
+                mask &= (1u << (ROWS % 32)) - 1;
+            }
+            return mask;
+        }
+
+        /**
+         * The number of rows is known at compile time, so the loop is unrolled. The
+         * first candidate is found without branches, since the matching block is
+         * random and the loop exit would be mispredicted.
+         */
+        __attribute__((target("avx2,bmi")))
+        static int scanAvx2(StateUid sid, SEventData event)
+        {
+            constexpr size_t WORDS = (SIZE + 63) / 64;
+            const __m256i eventId = _mm256_set1_epi8( static_cast<char>( event.event ) );
+            const __m256i state = _mm256_set1_epi8( static_cast<char>( sid ) );
+            const __m256i tag = _mm256_set1_epi8( static_cast<char>( argTag( event.arg ) ) );
+            uint64_t words[WORDS];
+#pragma GCC unroll 8
+            for (size_t w = 0; w < WORDS; w++)
+            {
+                words[w] = blockMask( w * 2, eventId, state, tag );
+                if ( w * 2 + 1 < SIZE / 32 )
+                {
+                    words[w] |= static_cast<uint64_t>( blockMask( w * 2 + 1, eventId, state, tag ) ) << 32;
+                }
+            }
+            // tzcnt of empty word is 64, so the offset of the next words is added only
+            // while the previous words are empty
+            uint64_t index = _tzcnt_u64( words[WORDS - 1] );
+#pragma GCC unroll 8
+            for (size_t w = WORDS - 1; w > 0; w--)
+            {
+                uint64_t empty = words[w - 1] == 0;
+                index = _tzcnt_u64( words[w - 1] ) + (index & (0 - empty));
+            }
+            if ( index >= ROWS || argMatches( index, event.arg ) )
+            {
+                return index >= ROWS ? -1 : static_cast<int>( index );
+            }
+            // Hashes of different arguments are equal, rare case
+            for (index++; index < ROWS; index++)
+            {
+                if ( data.events[index] == event.event &&
+                     (data.sources[index] == sid || data.sources[index] == SM_STATE_ANY) &&
+                     argMatches( index, event.arg ) )
+                {
+                    return static_cast<int>( index );
+                }
+            }
+            return -1;
+        }
+#endif
+
+        static int find(StateUid sid, SEventData event)
+        {
+#if SM_SCAN_AVX2
+            if ( scanHasAvx2 )
+            {
+                return scanAvx2( sid, event );
+            }
+#endif
+            return scanRows( scan, sid, event );
+        }
+    };
+
+    /**
+     * Transition table function, built from the array of SmTransitionRow, for states
+     * with many rows, too sparse for dense matrix. Rows are scanned in table order
+     * with vector compares, so the first matching row wins, like in macro tables.
+     */
+    template <const auto &rows>
+    STransitionData scanTable(StateUid sid, SEventData event)
+    {
+        int index = ScanRows<rows>::find( sid, event );
+        if ( index < 0 )
+        {
+            return { EEventResult::NOT_PROCESSED, SM_STATE_NONE };
+        }
+        const SmTransitionRow &row = rows[index];
+        if ( row.func ) row.func();
+        return { row.type, row.dest };
+    }
+}
+
+#endif
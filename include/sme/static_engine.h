@@ -0,0 +1,349 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2020, Aleksei Dynda
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "../sme/config.h"
+#include "../sme/event.h"
+#include "../sme/istate.h"
+#include "../sme/state_uid.h"
+#include "../sme/transition.h"
+#include "../sme/generic_state.h"
+
+#if SM_ENGINE_USE_STL && __cplusplus >= 201703L
+
+#include <stddef.h>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+/** Capacity of StaticEngine event queue */
+#ifndef SM_STATIC_ENGINE_QUEUE_SIZE
+#define SM_STATIC_ENGINE_QUEUE_SIZE 16
+#endif
+
+/** Maximum depth of StaticEngine state stack */
+#ifndef SM_STATIC_ENGINE_STACK_SIZE
+#define SM_STATIC_ENGINE_STACK_SIZE 8
+#endif
+
+namespace sme
+{
+    /**
+     * Binds state type to its id at compile time. T can be GenericState or any other
+     * ISmeState-based class, constructible from state id, or a plain class with
+     * enter(), update(), exit() and onEvent() methods.
+     */
+    template <StateUid id, class T>
+    class StaticState: public T
+    {
+    public:
+        static constexpr StateUid ID = id;
+
+        template <class U = T, typename std::enable_if<std::is_constructible<U, StateUid>::value, int>::type = 0>
+        StaticState(): T( id ) { }
+
+        template <class U = T, typename std::enable_if<!std::is_constructible<U, StateUid>::value, int>::type = 0>
+        StaticState(): T() { }
+
+        // Qualified calls are not virtual, so handlers can be inlined to the engine
+        bool staticBegin()
+        {
+            if constexpr ( std::is_base_of<ISmeState, T>::value ) return T::begin();
+            else return true;
+        }
+
+        void staticEnd()
+        {
+            if constexpr ( std::is_base_of<ISmeState, T>::value ) T::end();
+        }
+
+        void staticEnter(SEventData *event) { T::enter( event ); }
+        void staticUpdate() { T::update(); }
+        void staticExit(SEventData *event) { T::exit( event ); }
+        STransitionData staticEvent(SEventData event) { return T::onEvent( event ); }
+    };
+
+    /**
+     * Parent of ISmeState-based states of StaticEngine. Without it the states would
+     * use the engine, which runs in the current thread, and sendEvent() could reach
+     * an unrelated ISmEngine. Events are put to the StaticEngine queue, timers and
+     * timeouts are not supported.
+     */
+    template <class Engine>
+    class StaticLink: public ISmeState
+    {
+    public:
+        explicit StaticLink(Engine *engine): ISmeState( "static" ), m_engine( engine ) { }
+
+        void *getContext() override { return nullptr; }
+
+    protected:
+        bool sendEvent(SEventData event) override { return m_engine->sendEvent( event ); }
+
+        bool cancel(SmTimerHandle /*handle*/) override { return false; }
+
+        SmTimerHandle startTimer(SEventData /*event*/, uint32_t /*ms*/, uint32_t /*periodMs*/,
+                                 ETimerPolicy /*policy*/, ISmeState * /*owner*/) override
+        {
+            return SM_TIMER_INVALID;
+        }
+
+        bool timeoutEvent(uint64_t /*timeout*/, bool /*generate_event*/) override { return false; }
+
+        void resetTimeout() override { }
+
+    private:
+        Engine *m_engine;
+    };
+
+    /** Placeholder of StaticLink for engines without ISmeState-based states */
+    struct NoStaticLink
+    {
+        template <class Engine>
+        explicit NoStaticLink(Engine * /*engine*/) { }
+    };
+}
+
+/**
+ * State machine engine with the list of states, known at compile time.
+ *
+ * States are stored inline, and active state is found by generated switch over
+ * state ids, so there is no heap, no state list scan, and the compiler can inline
+ * state handlers into the event loop. The engine has no vtable. ISmeState-based
+ * states are bound to the engine, so their sendEvent() puts events to its queue,
+ * but they cannot use timers: use tables and the return value of onEvent() instead.
+ *
+ * @code{.cpp}
+ * StaticEngine<masterTable,
+ *              sme::StaticState<STATE_OFF, GenericState<enterOff, sme::NO_UPDATE, sme::NO_EXIT, offTable>>,
+ *              sme::StaticState<STATE_ON, GenericState<enterOn, sme::NO_UPDATE, sme::NO_EXIT, onTable>>> lamp;
+ * @endcode
+ *
+ * @tparam table engine transition table, processed before the table of active state
+ * @tparam States list of sme::StaticState types
+ */
+template <TSmeTable table, class... States>
+class StaticEngine
+{
+public:
+    StaticEngine()
+    {
+        std::apply( [this](auto &... state) { (bind( state ), ...); }, m_states );
+    }
+
+    // States keep pointer to the engine
+    StaticEngine(const StaticEngine &) = delete;
+    StaticEngine &operator=(const StaticEngine &) = delete;
+
+    /**
+     * Calls begin() of all states and switches to the initial state
+     */
+    bool begin(StateUid id)
+    {
+        bool result = true;
+        std::apply( [&result](auto &... state) { ((result = result && state.staticBegin()), ...); }, m_states );
+        return result && switchState( id, nullptr );
+    }
+
+    /**
+     * Exits active state and calls end() of all states
+     */
+    void end()
+    {
+        visit( m_activeId, [](auto &state) { state.staticExit( nullptr ); } );
+        m_activeId = SM_STATE_NONE;
+        std::apply( [](auto &... state) { (state.staticEnd(), ...); }, m_states );
+    }
+
+    /**
+     * Puts event to the engine queue. Returns false if the queue is full.
+     */
+    bool sendEvent(SEventData event)
+    {
+        if ( m_queueSize == SM_STATIC_ENGINE_QUEUE_SIZE )
+        {
+            return false;
+        }
+        m_queue[(m_queueHead + m_queueSize++) % SM_STATIC_ENGINE_QUEUE_SIZE] = event;
+        return true;
+    }
+
+    /**
+     * Processes all queued events and calls update() of active state
+     */
+    void update()
+    {
+        while ( m_queueSize )
+        {
+            SEventData event = m_queue[m_queueHead];
+            m_queueHead = (m_queueHead + 1) % SM_STATIC_ENGINE_QUEUE_SIZE;
+            m_queueSize--;
+            processEvent( event );
+        }
+        visit( m_activeId, [](auto &state) { state.staticUpdate(); } );
+    }
+
+    /**
+     * Processes single event immediately, bypassing the queue
+     */
+    EEventResult processEvent(SEventData event)
+    {
+        STransitionData status = table( m_activeId, event );
+        if ( status.result == EEventResult::NOT_PROCESSED )
+        {
+            visit( m_activeId, [&status, event](auto &state) { status = state.staticEvent( event ); } );
+        }
+        switch ( status.result )
+        {
+            case EEventResult::SWITCH_STATE: switchState( status.stateId, &event ); break;
+            case EEventResult::PUSH_STATE: pushState( status.stateId, &event ); break;
+            case EEventResult::POP_STATE: popState( &event ); break;
+            default: break;
+        }
+        return status.result;
+    }
+
+    /**
+     * Returns id of active state
+     */
+    StateUid getActiveId() const { return m_activeId; }
+
+    /**
+     * Returns state object by its type
+     */
+    template <class State>
+    State &getState() { return std::get<State>( m_states ); }
+
+private:
+    using StatesTuple = std::tuple<States...>;
+
+    static constexpr bool uniqueIds()
+    {
+        const StateUid ids[] = { States::ID..., SM_STATE_NONE };
+        for (size_t i = 0; i < sizeof...(States); i++)
+        {
+            if ( ids[i] == SM_STATE_NONE ) return false;
+            for (size_t j = 0; j < i; j++)
+            {
+                if ( ids[i] == ids[j] ) return false;
+            }
+        }
+        return true;
+    }
+
+    static_assert( uniqueIds(), "state ids must be unique and not equal to SM_STATE_NONE" );
+
+    static constexpr bool HAS_ISME_STATES = ( std::is_base_of<ISmeState, States>::value || ... );
+
+    using Link = typename std::conditional<HAS_ISME_STATES, sme::StaticLink<StaticEngine>, sme::NoStaticLink>::type;
+
+    StatesTuple m_states{};
+    Link m_link{ this };
+    SEventData m_queue[SM_STATIC_ENGINE_QUEUE_SIZE]{};
+    int m_queueHead = 0;
+    int m_queueSize = 0;
+    StateUid m_stack[SM_STATIC_ENGINE_STACK_SIZE]{};
+    int m_stackSize = 0;
+    StateUid m_activeId = SM_STATE_NONE;
+
+    template <class State>
+    void bind(State &state)
+    {
+        if constexpr ( std::is_base_of<ISmeState, State>::value )
+        {
+            state.setParent( &m_link );
+        }
+    }
+
+    template <class F, size_t... I>
+    bool visit(StateUid id, F &&func, std::index_sequence<I...>)
+    {
+        return ( (id == std::tuple_element<I, StatesTuple>::type::ID && (func( std::get<I>( m_states ) ), true)) || ... );
+    }
+
+    /**
+     * Calls func for the state with the id. Returns false if there is no such state.
+     */
+    template <class F>
+    bool visit(StateUid id, F &&func)
+    {
+        return visit( id, func, std::index_sequence_for<States...>{} );
+    }
+
+    bool switchState(StateUid id, SEventData *event)
+    {
+        if ( id == SM_STATE_NONE )
+        {
+            return true;
+        }
+        if ( id == m_activeId || !visit( id, [](auto &) { } ) )
+        {
+            return false;
+        }
+        visit( m_activeId, [event](auto &state) { state.staticExit( event ); } );
+        m_activeId = id;
+        visit( id, [event](auto &state) { state.staticEnter( event ); } );
+        return true;
+    }
+
+    bool pushState(StateUid id, SEventData *event)
+    {
+        if ( m_stackSize == SM_STATIC_ENGINE_STACK_SIZE )
+        {
+            return false;
+        }
+        m_stack[m_stackSize++] = m_activeId;
+        if ( !switchState( id, event ) )
+        {
+            m_stackSize--;
+            return false;
+        }
+        return true;
+    }
+
+    bool popState(SEventData *event)
+    {
+        if ( m_stackSize == 0 )
+        {
+            return false;
+        }
+        if ( !switchState( m_stack[--m_stackSize], event ) )
+        {
+            m_stackSize++;
+            return false;
+        }
+        return true;
+    }
+};
+
+#endif
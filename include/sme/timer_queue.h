@@ -0,0 +1,189 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2020, Aleksei Dynda
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "../sme/event.h"
+#include "../containers/vector.h"
+
+#include <stdint.h>
+
+/**
+ * Pending timer, reported by SmTimerQueue::forEach()
+ */
+typedef struct
+{
+    SEventData event;
+    uint64_t deadline;
+    uint64_t period;
+    SmTimerHandle handle;
+    ETimerPolicy policy;
+    bool bound;
+} SmTimerRecord;
+
+/**
+ * Min-heap of deferred events ordered by absolute deadline.
+ * Insertion and expiration take O(log n), cancellation is O(1): cancelled timer
+ * is marked stale and is silently dropped, when it reaches the top of the heap.
+ * The class is not thread-safe, the engine protects it with its own lock.
+ */
+class SmTimerQueue
+{
+public:
+    SmTimerQueue() = default;
+
+    /**
+     * Adds new deferred event
+     *
+     * @param event event to put to queue
+     * @param deadline absolute time in microseconds, when event must be fired
+     * @param bound true if timer must be cancelled by the next cancelBound() call
+     * @param period period in microseconds for periodic timer, 0 for one-shot timer
+     * @param policy defines how periodic timer handles missed ticks
+     * @return handle of new timer or SM_TIMER_INVALID if there is no free space
+     */
+    SmTimerHandle add(SEventData event, uint64_t deadline, bool bound = false,
+                      uint64_t period = 0, ETimerPolicy policy = ETimerPolicy::SKIP);
+
+    /**
+     * Cancels the timer. Returns false if timer is already fired or cancelled.
+     */
+    bool cancel(SmTimerHandle handle);
+
+    /**
+     * Cancels all timers, added with bound flag set.
+     */
+    void cancelBound();
+
+    /**
+     * Returns true if there is at least one timer, and sets deadline to
+     * the nearest timer deadline.
+     */
+    bool getNextDeadline(uint64_t &deadline);
+
+    /**
+     * Removes the nearest timer if its deadline is not later than now.
+     * Periodic timer is not removed, but is rescheduled to its next tick.
+     *
+     * @param now current timestamp in microseconds
+     * @param event the event of expired timer
+     * @return true if expired timer is found
+     */
+    bool popExpired(uint64_t now, SEventData &event);
+
+    /**
+     * Saves generations of the timer slots. Pending timers are counted as cancelled,
+     * so none of the issued handles matches the timers, added after restoreGenerations()
+     */
+    void saveGenerations(sme::vector<uint16_t> &gens) const;
+
+    /**
+     * Clears the queue and restores generations of the timer slots, saved by
+     * saveGenerations(). Handles, issued before the save, are rejected by cancel().
+     */
+    void restoreGenerations(const sme::vector<uint16_t> &gens);
+
+    /**
+     * Returns number of pending timers
+     */
+    int size() const { return m_count; }
+
+    /**
+     * Calls func(const SmTimerRecord &) for each pending timer in unspecified order
+     */
+    template <typename F>
+    void forEach(F func) const
+    {
+        for (int i = 0; i < heapSize(); i++)
+        {
+            const Entry &entry = m_heap[i];
+            if ( isStale( entry ) )
+            {
+                continue;
+            }
+            const Slot &slot = m_slots[entry.slot];
+            SmTimerRecord record =
+            {
+                .event = slot.event,
+                .deadline = entry.deadline,
+                .period = slot.period,
+                .handle = (static_cast<uint32_t>( entry.gen ) << 16) | entry.slot,
+                .policy = slot.policy,
+                .bound = slot.epoch != 0,
+            };
+            func( record );
+        }
+    }
+
+private:
+    typedef struct
+    {
+        uint64_t deadline;
+        uint16_t slot;
+        uint16_t gen;
+    } Entry;
+
+    typedef struct
+    {
+        SEventData event;
+        uint64_t period;
+        uint32_t epoch;
+        uint16_t gen;
+        uint16_t next;
+        ETimerPolicy policy;
+    } Slot;
+
+    sme::vector<Entry> m_heap{};
+    sme::vector<Slot> m_slots{};
+    uint16_t m_free = UINT16_MAX;
+    uint32_t m_epoch = 1;
+    int m_count = 0;
+    int m_stale = 0;
+
+    int heapSize() const { return static_cast<int>( m_heap.size() ); }
+
+    bool isStale(const Entry &entry) const;
+
+    bool allocSlot(uint16_t &index);
+
+    void freeSlot(uint16_t index);
+
+    void removeTop();
+
+    bool rescheduleTop(uint64_t now);
+
+    void compact();
+
+    void siftUp(int index);
+
+    void siftDown(int index);
+};
@@ -0,0 +1,324 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2020, Aleksei Dynda
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "sme/executor.h"
+
+#if SM_ENGINE_MULTITHREAD && SM_ENGINE_USE_STL
+
+#include <chrono>
+
+// Worker of the executor, running in current thread
+static thread_local SmExecutor *t_executor = nullptr;
+static thread_local int t_worker = -1;
+
+SmExecutor::SmExecutor(int workers)
+{
+    if ( workers <= 0 )
+    {
+        workers = static_cast<int>( std::thread::hardware_concurrency() );
+    }
+    for (int i = 0; i < (workers > 0 ? workers : 1); i++)
+    {
+        m_workers.emplace_back( new Worker() );
+    }
+}
+
+SmExecutor::~SmExecutor()
+{
+    stop();
+    for (auto &task: m_tasks)
+    {
+        task->engine->setNotifier( nullptr, nullptr );
+    }
+}
+
+void SmExecutor::add(ISmEngine &engine)
+{
+    Task *task = new Task();
+    task->engine = &engine;
+    task->owner = this;
+    {
+        std::unique_lock<std::mutex> lock( m_mutex );
+        m_tasks.emplace_back( task );
+    }
+    engine.setNotifier( &SmExecutor::notify, task );
+    // Let the engine process the events, sent before it was added
+    schedule( task );
+}
+
+void SmExecutor::start()
+{
+    if ( m_running.exchange( true ) )
+    {
+        return;
+    }
+    for (size_t i = 0; i < m_workers.size(); i++)
+    {
+        m_workers[i]->thread = std::thread( &SmExecutor::run, this, static_cast<int>( i ) );
+    }
+}
+
+void SmExecutor::stop()
+{
+    if ( !m_running.exchange( false ) )
+    {
+        return;
+    }
+    {
+        std::unique_lock<std::mutex> lock( m_mutex );
+        m_cond.notify_all();
+    }
+    for (auto &worker: m_workers)
+    {
+        worker->thread.join();
+    }
+}
+
+void SmExecutor::notify(ISmEngine *engine, void *arg)
+{
+    Task *task = static_cast<Task *>( arg );
+    // Ignore the engine, which was re-registered after the notifier was set
+    if ( task->engine != engine )
+    {
+        return;
+    }
+    task->owner->schedule( task );
+}
+
+uint64_t SmExecutor::now()
+{
+    return std::chrono::time_point_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now() ).time_since_epoch().count();
+}
+
+void SmExecutor::schedule(Task *task)
+{
+    uint8_t state = task->state.load( std::memory_order_acquire );
+    for (;;)
+    {
+        if ( state == IDLE )
+        {
+            if ( task->state.compare_exchange_weak( state, QUEUED, std::memory_order_acq_rel ) )
+            {
+                push( task );
+                return;
+            }
+        }
+        else if ( state == RUNNING )
+        {
+            // The worker, running the engine, requeues it after processing
+            if ( task->state.compare_exchange_weak( state, NOTIFIED, std::memory_order_acq_rel ) )
+            {
+                return;
+            }
+        }
+        else
+        {
+            return;
+        }
+    }
+}
+
+void SmExecutor::push(Task *task)
+{
+    // Workers keep the engines, woken by them, in own queue
+    size_t index = t_executor == this ? static_cast<size_t>( t_worker ) :
+                   m_nextWorker.fetch_add( 1, std::memory_order_relaxed ) % m_workers.size();
+    {
+        Worker &worker = *m_workers[index];
+        std::unique_lock<std::mutex> lock( worker.mutex );
+        worker.queue.push_back( task );
+    }
+    // Pairs with the fence in run(): either idle worker sees new task, or
+    // producer sees the worker sleeping and wakes it up
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+    if ( m_sleeping.load( std::memory_order_relaxed ) > 0 )
+    {
+        std::unique_lock<std::mutex> lock( m_mutex );
+        m_cond.notify_one();
+    }
+}
+
+SmExecutor::Task *SmExecutor::pop(int index)
+{
+    {
+        Worker &worker = *m_workers[index];
+        std::unique_lock<std::mutex> lock( worker.mutex );
+        if ( !worker.queue.empty() )
+        {
+            Task *task = worker.queue.front();
+            worker.queue.pop_front();
+            return task;
+        }
+    }
+    // Steal from the tail of other queues, the owner works at the head
+    for (size_t i = 1; i < m_workers.size(); i++)
+    {
+        Worker &victim = *m_workers[(index + i) % m_workers.size()];
+        std::unique_lock<std::mutex> lock( victim.mutex );
+        if ( !victim.queue.empty() )
+        {
+            Task *task = victim.queue.back();
+            victim.queue.pop_back();
+            m_steals.fetch_add( 1, std::memory_order_relaxed );
+            return task;
+        }
+    }
+    return nullptr;
+}
+
+bool SmExecutor::hasWork()
+{
+    for (auto &worker: m_workers)
+    {
+        std::unique_lock<std::mutex> lock( worker->mutex );
+        if ( !worker->queue.empty() )
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void SmExecutor::execute(Task *task)
+{
+    task->state.store( RUNNING, std::memory_order_release );
+    ISmEngine *engine = task->engine;
+    engine->processReady();
+    uint64_t deadline = engine->getNextDeadline();
+    if ( deadline != UINT64_MAX )
+    {
+        // Engine deadline is converted to executor clock, since getMicros() can be overridden
+        uint64_t engineNow = engine->getMicros();
+        deadline = now() + (deadline > engineNow ? deadline - engineNow : 0);
+    }
+    uint8_t state = RUNNING;
+    if ( task->state.compare_exchange_strong( state, IDLE, std::memory_order_acq_rel ) )
+    {
+        if ( deadline != UINT64_MAX )
+        {
+            addTimer( task, deadline );
+        }
+        return;
+    }
+    // New work arrived during processing
+    task->state.store( QUEUED, std::memory_order_release );
+    push( task );
+}
+
+void SmExecutor::addTimer(Task *task, uint64_t deadline)
+{
+    std::unique_lock<std::mutex> lock( m_mutex );
+    // Later entries are not needed, the task is rescheduled at the earlier one anyway
+    if ( deadline >= task->timerDeadline )
+    {
+        return;
+    }
+    task->timerDeadline = deadline;
+    bool earliest = m_timers.empty() || deadline < m_timers.top().deadline;
+    m_timers.push( { deadline, task } );
+    if ( earliest )
+    {
+        m_nextTimer.store( deadline, std::memory_order_relaxed );
+        if ( m_sleeping.load( std::memory_order_relaxed ) > 0 )
+        {
+            m_cond.notify_one();
+        }
+    }
+}
+
+void SmExecutor::takeDueTimers(uint64_t ts, std::vector<Task *> &due)
+{
+    while ( !m_timers.empty() && m_timers.top().deadline <= ts )
+    {
+        Timer timer = m_timers.top();
+        m_timers.pop();
+        if ( timer.deadline == timer.task->timerDeadline )
+        {
+            timer.task->timerDeadline = UINT64_MAX;
+        }
+        due.push_back( timer.task );
+    }
+    m_nextTimer.store( m_timers.empty() ? UINT64_MAX : m_timers.top().deadline, std::memory_order_relaxed );
+}
+
+void SmExecutor::run(int index)
+{
+    t_executor = this;
+    t_worker = index;
+    std::vector<Task *> due;
+    while ( m_running.load( std::memory_order_relaxed ) )
+    {
+        // Timers are checked before every task, busy run queues must not delay them
+        if ( m_nextTimer.load( std::memory_order_relaxed ) <= now() )
+        {
+            std::unique_lock<std::mutex> lock( m_mutex );
+            takeDueTimers( now(), due );
+        }
+        for (Task *t: due)
+        {
+            schedule( t );
+        }
+        due.clear();
+        Task *task = pop( index );
+        if ( task != nullptr )
+        {
+            execute( task );
+            continue;
+        }
+        std::unique_lock<std::mutex> lock( m_mutex );
+        uint64_t ts = now();
+        takeDueTimers( ts, due );
+        if ( !due.empty() )
+        {
+            continue;
+        }
+        m_sleeping.fetch_add( 1, std::memory_order_relaxed );
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+        if ( !hasWork() && m_running.load( std::memory_order_relaxed ) )
+        {
+            if ( m_timers.empty() )
+            {
+                m_cond.wait( lock );
+            }
+            else
+            {
+                m_cond.wait_for( lock, std::chrono::microseconds( m_timers.top().deadline - ts ) );
+            }
+        }
+        m_sleeping.fetch_sub( 1, std::memory_order_relaxed );
+    }
+    t_executor = nullptr;
+    t_worker = -1;
+}
+
+#endif
@@ -0,0 +1,131 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2020, Aleksei Dynda
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "sme/fleet.h"
+
+#if SM_ENGINE_USE_STL
+
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define SM_FLEET_AVX2 1
+#include <immintrin.h>
+#else
+#define SM_FLEET_AVX2 0
+#endif
+
+static int stepScalar(uint8_t *states, uint16_t *events, const uint8_t *next, int columns,
+                      int begin, int count, int *slow, int slowCount)
+{
+    for (int i = begin; i < count; i++)
+    {
+        if ( events[i] == SM_FLEET_NO_EVENT )
+        {
+            continue;
+        }
+        uint8_t state = next[states[i] * columns + events[i]];
+        if ( state == SM_STATE_NONE )
+        {
+            slow[slowCount++] = i;
+            continue;
+        }
+        states[i] = state;
+        events[i] = SM_FLEET_NO_EVENT;
+    }
+    return slowCount;
+}
+
+#if SM_FLEET_AVX2
+__attribute__((target("avx2")))
+static int stepAvx2(uint8_t *states, uint16_t *events, const uint8_t *next, int columns,
+                    int count, int *slow)
+{
+    const __m256i none = _mm256_set1_epi32( SM_FLEET_NO_EVENT );
+    const __m256i width = _mm256_set1_epi32( columns );
+    const __m256i mask = _mm256_set1_epi32( 0xFF );
+    int slowCount = 0;
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i e = _mm256_cvtepu16_epi32( _mm_loadu_si128( reinterpret_cast<const __m128i *>( events + i ) ) );
+        if ( _mm256_movemask_epi8( _mm256_cmpeq_epi32( e, none ) ) == -1 )
+        {
+            continue;
+        }
+        __m256i s = _mm256_cvtepu8_epi32( _mm_loadl_epi64( reinterpret_cast<const __m128i *>( states + i ) ) );
+        // Instances without events read the column, which keeps their state
+        __m256i index = _mm256_add_epi32( _mm256_mullo_epi32( s, width ), e );
+        __m256i n = _mm256_and_si256( _mm256_i32gather_epi32( reinterpret_cast<const int *>( next ), index, 1 ), mask );
+        __m256i isSlow = _mm256_cmpeq_epi32( n, mask );
+        n = _mm256_blendv_epi8( n, s, isSlow );
+        e = _mm256_blendv_epi8( none, e, isSlow );
+        // Pack 32-bit lanes back to bytes and words
+        __m256i n8 = _mm256_packus_epi16( _mm256_packus_epi32( n, n ), n );
+        uint32_t low = _mm256_extract_epi32( n8, 0 );
+        uint32_t high = _mm256_extract_epi32( n8, 4 );
+        memcpy( states + i, &low, 4 );
+        memcpy( states + i + 4, &high, 4 );
+        __m256i e16 = _mm256_permute4x64_epi64( _mm256_packus_epi32( e, e ), 0x08 );
+        _mm_storeu_si128( reinterpret_cast<__m128i *>( events + i ), _mm256_castsi256_si128( e16 ) );
+        int lanes = _mm256_movemask_ps( _mm256_castsi256_ps( isSlow ) );
+        while ( lanes )
+        {
+            slow[slowCount++] = i + __builtin_ctz( lanes );
+            lanes &= lanes - 1;
+        }
+    }
+    return stepScalar( states, events, next, columns, i, count, slow, slowCount );
+}
+#endif
+
+bool sme::fleetVectorized()
+{
+#if SM_FLEET_AVX2
+    return __builtin_cpu_supports( "avx2" );
+#else
+    return false;
+#endif
+}
+
+int sme::fleetStep(uint8_t *states, uint16_t *events, const uint8_t *next, int columns,
+                   int count, int *slow, bool vectorized)
+{
+#if SM_FLEET_AVX2
+    if ( vectorized )
+    {
+        return stepAvx2( states, events, next, columns, count, slow );
+    }
+#endif
+    return stepScalar( states, events, next, columns, 0, count, slow, 0 );
+}
+
+#endif
@@ -33,12 +33,17 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "sme/iengine.h"
 #include "sme/state.h"
 #include "sm_engine_logger.h"
+#include <limits.h>
+#if SM_ENGINE_POLL_FD
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#endif
 #if SM_ENGINE_USE_STL
 #include <chrono>
+#include <thread>
 #endif
 
-#define MAX_APP_QUEUE_SIZE   10
-
 static const char* TAG = "SME";
 
 ISmEngine::~ISmEngine()
@@ -47,41 +52,615 @@ ISmEngine::~ISmEngine()
     while ( state->state != nullptr )
     {
 #if SM_ENGINE_DYNAMIC_ALLOC
-        if (state->autoAllocated)
+        // The table can be shared by other engines, only own states are deleted
+        if (state->autoAllocated && state->state->isOwnedBy( this ))
         {
             delete state->state;
         }
 #endif
         state++;
     }
+    delete m_coalesced;
+#if SM_ENGINE_PRIORITY_LANES > 1
+    delete[] m_eventLane;
+#endif
+#if SM_ENGINE_POLL_FD
+    if ( m_eventFd >= 0 ) close( m_eventFd );
+    if ( m_timerFd >= 0 ) close( m_timerFd );
+#endif
+    delete m_filters;
+    delete[] m_cache;
+    dropStateIndex();
+}
+
+SmTimerHandle ISmEngine::startTimer(SEventData event, uint32_t ms, uint32_t periodMs,
+                                    ETimerPolicy policy, ISmeState *owner)
+{
+    uint64_t deadline = getMicros() + static_cast<uint64_t>( ms ) * 1000;
+    // Only timers of active state can be cancelled on state exit
+    bool bound = m_cancelTimersOnExit && owner != nullptr && owner == m_active;
+#if SM_ENGINE_MULTITHREAD
+    std::unique_lock<std::mutex> lock( m_timerMutex );
+#endif
+    SmTimerHandle handle = m_timers.add( event, deadline, bound,
+                                         static_cast<uint64_t>( periodMs ) * 1000, policy );
+    if ( handle == SM_TIMER_INVALID )
+    {
+        ESP_LOGE( TAG, "Failed to put new deferred event: %02X", event.event );
+        return SM_TIMER_INVALID;
+    }
+    if ( deadline < m_nextDeadline )
+    {
+        m_nextDeadline = deadline;
+#if SM_ENGINE_MULTITHREAD
+        lock.unlock();
+#endif
+        // Sleeping engine must recalculate its wake up time
+        wakeUp();
+    }
+    ESP_LOGI( TAG, "New deferred event: %02X", event.event );
+    return handle;
+}
+
+bool ISmEngine::cancel(SmTimerHandle handle)
+{
+#if SM_ENGINE_MULTITHREAD
+    std::unique_lock<std::mutex> lock( m_timerMutex );
+#endif
+    return m_timers.cancel( handle );
+}
+
+void ISmEngine::armStateTimeout()
+{
+    uint32_t ms = m_active->getTimeout();
+    if ( ms > 0 )
+    {
+        m_stateTimer = startTimer( { SM_EVENT_TIMEOUT, static_cast<uintptr_t>( ms ) * 1000 },
+                                   ms, 0, ETimerPolicy::SKIP, nullptr );
+    }
+}
+
+void ISmEngine::cancelStateTimeout()
+{
+    if ( m_stateTimer != SM_TIMER_INVALID )
+    {
+        cancel( m_stateTimer );
+        m_stateTimer = SM_TIMER_INVALID;
+    }
+}
+
+bool ISmEngine::popExpiredTimer(uint64_t now, SEventData &event)
+{
+    // Fast path without lock: no timers are due yet
+    if ( now < m_nextDeadline )
+    {
+        return false;
+    }
+#if SM_ENGINE_MULTITHREAD
+    std::unique_lock<std::mutex> lock( m_timerMutex );
+#endif
+    bool result = m_timers.popExpired( now, event );
+    uint64_t deadline = UINT64_MAX;
+    m_timers.getNextDeadline( deadline );
+    m_nextDeadline = deadline;
+    return result;
+}
+
+bool ISmEngine::setEventFilter(uint8_t eventId, EEventFilter filter, uint32_t intervalMs)
+{
+    if ( m_filters == nullptr )
+    {
+        m_filters = new FilterTable();
+    }
+    m_filters->filters[eventId] = EventFilter();
+    m_filters->filters[eventId].type = filter;
+    m_filters->filters[eventId].interval = static_cast<uint64_t>( intervalMs ) * 1000;
+    if ( filter != EEventFilter::NONE )
+    {
+        m_filters->mask[eventId >> 5] |= 1UL << (eventId & 31);
+    }
+    else
+    {
+        m_filters->mask[eventId >> 5] &= ~(1UL << (eventId & 31));
+    }
+    return true;
+}
+
+bool ISmEngine::filterEvent(SEventData event, uint64_t now)
+{
+    EventFilter &filter = m_filters->filters[event.event];
+    bool quiet = !filter.seen || now - filter.last >= filter.interval;
+    switch ( filter.type )
+    {
+        case EEventFilter::DEBOUNCE_LEADING:
+            // Every event extends the window, even the dropped one
+            filter.seen = true;
+            filter.last = now;
+            return quiet;
+        case EEventFilter::DEBOUNCE_TRAILING:
+            if ( filter.timer != SM_TIMER_INVALID )
+            {
+                cancel( filter.timer );
+            }
+            filter.timer = startTimer( event, filter.interval / 1000, 0, ETimerPolicy::SKIP, nullptr );
+            // Dispatch immediately if the event cannot be postponed
+            return filter.timer == SM_TIMER_INVALID;
+        case EEventFilter::THROTTLE:
+            if ( quiet )
+            {
+                filter.seen = true;
+                filter.last = now;
+            }
+            return quiet;
+        default:
+            return true;
+    }
 }
 
 bool ISmEngine::sendEvent(SEventData event)
 {
-    return sendEvent(event, 0);
+    return sendPriorityEvent( event, getEventLane( event.event ) );
+}
+
+bool ISmEngine::isInterested(uint8_t eventId)
+{
+    const SmEventMask *engine = m_engineInterest;
+    const SmEventMask *state = m_activeInterest;
+    return engine == nullptr || state == nullptr ||
+           sme::hasEvent( *engine, eventId ) || sme::hasEvent( *state, eventId );
+}
+
+bool ISmEngine::dropOnSend(uint8_t eventId)
+{
+    if ( m_interestPolicy != EInterestPolicy::DROP_ON_SEND || isInterested( eventId ) )
+    {
+        return false;
+    }
+    m_uninterested++;
+    ESP_LOGI( TAG, "Event dropped, active state is not interested: %02X", eventId );
+    return true;
+}
+
+bool ISmEngine::sendPriorityEvent(SEventData event, uint8_t lane)
+{
+    if ( lane >= SM_ENGINE_PRIORITY_LANES )
+    {
+        lane = SM_ENGINE_PRIORITY_LANES - 1;
+    }
+    if ( !m_lanes[lane].enabled )
+    {
+        lane = SM_LANE_DEFAULT;
+    }
+    if ( dropOnSend( event.event ) )
+    {
+        return false;
+    }
+    if ( !pushEvent( event, lane ) )
+    {
+        return false;
+    }
+    wakeUp();
+    return true;
+}
+
+bool ISmEngine::pushEvent(SEventData event, uint8_t lane)
+{
+    if ( isCoalesced( event.event ) )
+    {
+        return pushCoalesced( event, lane );
+    }
+    if ( !pushLane( m_lanes[lane], event ) )
+    {
+        return false;
+    }
+    ESP_LOGI( TAG, "New event arrived: %02X", event.event );
+    return true;
+}
+
+bool ISmEngine::pushLane(Lane &lane, SEventData event)
+{
+    if ( lane.queue.push( event ) )
+    {
+        return true;
+    }
+    SEventData oldest;
+    switch ( m_overflowPolicy )
+    {
+        case EOverflowPolicy::DROP_OLDEST:
+            // Other producers can take the freed cell, so repeat until the lane is empty
+            while ( lane.queue.evict( oldest ) )
+            {
+                lane.evicted++;
+                if ( isCoalesced( oldest.event ) )
+                {
+                    m_coalesced->slots[oldest.event].state = COALESCE_IDLE;
+                }
+                ESP_LOGE( TAG, "Event dropped: %02X", oldest.event );
+                if ( lane.queue.push( event ) )
+                {
+                    return true;
+                }
+            }
+            break;
+        case EOverflowPolicy::OVERWRITE_SAME_ID:
+            if ( lane.queue.replace( event, [&event](const SEventData &e)->bool{ return e.event == event.event; } ) )
+            {
+                lane.overwritten++;
+                return true;
+            }
+            break;
+        case EOverflowPolicy::BLOCK:
+            if ( waitForSpace( lane, event ) )
+            {
+                return true;
+            }
+            break;
+        case EOverflowPolicy::GROW:
+            while ( lane.queue.grow() )
+            {
+                lane.grown++;
+                if ( lane.queue.push( event ) )
+                {
+                    return true;
+                }
+            }
+            break;
+        default:
+            break;
+    }
+    lane.rejected++;
+    ESP_LOGE( TAG, "Failed to put new event: %02X", event.event );
+    return false;
+}
+
+bool ISmEngine::waitForSpace(Lane &lane, SEventData event)
+{
+#if SM_ENGINE_MULTITHREAD
+    // update() thread would wait for itself
+    if ( m_blockTimeoutMs == 0 || m_consumerThread.load( std::memory_order_relaxed ) == std::this_thread::get_id() )
+    {
+        return false;
+    }
+    lane.blocked++;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds( m_blockTimeoutMs );
+    std::unique_lock<std::mutex> lock( m_mutex );
+    // Pairs with the fence in notifySpace(): either producer sees the free room,
+    // or consumer sees the producer waiting and wakes it up.
+    m_blockedProducers.fetch_add( 1, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+    bool pushed;
+    while ( !(pushed = lane.queue.push( event )) )
+    {
+        if ( m_spaceCond.wait_until( lock, deadline ) == std::cv_status::timeout )
+        {
+            pushed = lane.queue.push( event );
+            break;
+        }
+    }
+    m_blockedProducers.fetch_sub( 1, std::memory_order_relaxed );
+    if ( !pushed )
+    {
+        lane.timedOut++;
+    }
+    return pushed;
+#else
+    (void)lane;
+    (void)event;
+    return false;
+#endif
+}
+
+void ISmEngine::notifySpace()
+{
+#if SM_ENGINE_MULTITHREAD
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+    if ( m_blockedProducers.load( std::memory_order_relaxed ) > 0 )
+    {
+        std::unique_lock<std::mutex> lock( m_mutex );
+        m_spaceCond.notify_all();
+    }
+#endif
+}
+
+bool ISmEngine::pushCoalesced(SEventData event, uint8_t lane)
+{
+    CoalescedEvent &slot = m_coalesced->slots[event.event];
+#if SM_ENGINE_MULTITHREAD
+    for (;;)
+    {
+        // The value is published before the state is checked, so the consumer,
+        // which resets the state, always reads the latest argument
+        slot.arg.store( event.arg, std::memory_order_relaxed );
+        uint8_t state = COALESCE_QUEUED;
+        if ( slot.state.compare_exchange_strong( state, COALESCE_QUEUED, std::memory_order_acq_rel ) )
+        {
+            ESP_LOGI( TAG, "Event coalesced: %02X", event.event );
+            return true;
+        }
+        if ( state == COALESCE_RESERVING )
+        {
+            // Other producer puts the event to the lane, the result is not known yet
+            std::this_thread::yield();
+            continue;
+        }
+        if ( slot.state.compare_exchange_strong( state, COALESCE_RESERVING, std::memory_order_acq_rel ) )
+        {
+            break;
+        }
+    }
+    if ( !pushLane( m_lanes[lane], event ) )
+    {
+        // Producers, waiting for the result, try to put the event themselves
+        uint8_t state = COALESCE_RESERVING;
+        slot.state.compare_exchange_strong( state, COALESCE_IDLE, std::memory_order_acq_rel );
+        return false;
+    }
+    // The consumer could already take the event, then the slot stays idle
+    uint8_t state = COALESCE_RESERVING;
+    slot.state.compare_exchange_strong( state, COALESCE_QUEUED, std::memory_order_acq_rel );
+#else
+    slot.arg = event.arg;
+    if ( slot.state == COALESCE_QUEUED )
+    {
+        ESP_LOGI( TAG, "Event coalesced: %02X", event.event );
+        return true;
+    }
+    if ( !pushLane( m_lanes[lane], event ) )
+    {
+        return false;
+    }
+    slot.state = COALESCE_QUEUED;
+#endif
+    ESP_LOGI( TAG, "New event arrived: %02X", event.event );
+    return true;
+}
+
+void ISmEngine::takeCoalesced(SEventData &event)
+{
+    CoalescedEvent &slot = m_coalesced->slots[event.event];
+#if SM_ENGINE_MULTITHREAD
+    slot.state.exchange( COALESCE_IDLE, std::memory_order_acq_rel );
+    event.arg = slot.arg.load( std::memory_order_relaxed );
+#else
+    slot.state = COALESCE_IDLE;
+    event.arg = slot.arg;
+#endif
+}
+
+bool ISmEngine::setEventCoalescing(uint8_t eventId, bool enable)
+{
+    if ( m_coalesced == nullptr )
+    {
+        m_coalesced = new CoalesceTable();
+    }
+    if ( enable )
+    {
+        m_coalesced->mask[eventId >> 5] |= 1UL << (eventId & 31);
+    }
+    else
+    {
+        m_coalesced->mask[eventId >> 5] &= ~(1UL << (eventId & 31));
+    }
+    return true;
+}
+
+size_t ISmEngine::sendEvents(const SEventData *events, size_t count)
+{
+    size_t sent = 0;
+    while ( sent < count )
+    {
+        if ( dropOnSend( events[sent].event ) )
+        {
+            sent++;
+            continue;
+        }
+        uint8_t lane = getEventLane( events[sent].event );
+        if ( isCoalesced( events[sent].event ) )
+        {
+            if ( !pushEvent( events[sent], lane ) )
+            {
+                break;
+            }
+            sent++;
+            continue;
+        }
+        // Put the run of events, going to the same lane, at once
+        size_t run = 1;
+        while ( sent + run < count && getEventLane( events[sent + run].event ) == lane &&
+                !isCoalesced( events[sent + run].event ) &&
+                ( m_interestPolicy != EInterestPolicy::DROP_ON_SEND || isInterested( events[sent + run].event ) ) )
+        {
+            run++;
+        }
+        int n = m_lanes[lane].queue.push( events + sent, static_cast<int>( run ) );
+        sent += n;
+        // The lane is full, next event goes through the overflow policy
+        if ( static_cast<size_t>( n ) < run )
+        {
+            if ( !pushLane( m_lanes[lane], events[sent] ) )
+            {
+                break;
+            }
+            sent++;
+        }
+    }
+    if ( sent > 0 )
+    {
+        wakeUp();
+    }
+    return sent;
+}
+
+uint8_t ISmEngine::getEventLane(uint8_t eventId)
+{
+#if SM_ENGINE_PRIORITY_LANES > 1
+    uint8_t lane = SM_LANE_DEFAULT;
+    if ( m_eventLane != nullptr )
+    {
+        lane = m_eventLane[eventId];
+    }
+    else if ( eventId == SM_EVENT_TIMEOUT )
+    {
+        lane = 0;
+    }
+    return m_lanes[lane].enabled ? lane : SM_LANE_DEFAULT;
+#else
+    return 0;
+#endif
+}
+
+void ISmEngine::setEventPriority(uint8_t eventId, uint8_t lane)
+{
+#if SM_ENGINE_PRIORITY_LANES > 1
+    if ( m_eventLane == nullptr )
+    {
+        m_eventLane = new uint8_t[256];
+        for (int id = 0; id < 256; id++)
+        {
+            m_eventLane[id] = SM_LANE_DEFAULT;
+        }
+        m_eventLane[SM_EVENT_TIMEOUT] = 0;
+    }
+    m_eventLane[eventId] = lane < SM_ENGINE_PRIORITY_LANES ? lane : SM_ENGINE_PRIORITY_LANES - 1;
+#endif
+}
+
+void ISmEngine::setLaneCapacity(uint8_t lane, int capacity, int ceiling)
+{
+    if ( lane < SM_ENGINE_PRIORITY_LANES )
+    {
+        m_lanes[lane].queue.reset( capacity, ceiling );
+        m_lanes[lane].enabled = true;
+    }
+}
+
+void ISmEngine::setOverflowPolicy(EOverflowPolicy policy, uint32_t blockTimeoutMs)
+{
+    m_overflowPolicy = policy;
+    m_blockTimeoutMs = blockTimeoutMs;
+}
+
+void ISmEngine::setLaneWeight(uint8_t lane, uint8_t weight)
+{
+    if ( lane < SM_ENGINE_PRIORITY_LANES )
+    {
+        m_lanes[lane].weight = weight ? weight : 1;
+    }
+}
+
+uint32_t ISmEngine::getDroppedEvents(uint8_t lane)
+{
+    SmQueueStats stats = getQueueStats( lane );
+    return stats.rejected + stats.evicted;
+}
+
+SmQueueStats ISmEngine::getQueueStats(uint8_t lane)
+{
+    SmQueueStats stats{};
+    if ( lane < SM_ENGINE_PRIORITY_LANES )
+    {
+        stats.rejected = m_lanes[lane].rejected;
+        stats.evicted = m_lanes[lane].evicted;
+        stats.overwritten = m_lanes[lane].overwritten;
+        stats.blocked = m_lanes[lane].blocked;
+        stats.timedOut = m_lanes[lane].timedOut;
+        stats.grown = m_lanes[lane].grown;
+    }
+    return stats;
+}
+
+bool ISmEngine::hasEvents()
+{
+    for (auto &lane: m_lanes)
+    {
+        if ( !lane.queue.empty() )
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+int ISmEngine::nextLane(int *ready, int *credit)
+{
+    if ( m_drainPolicy == ELaneDrainPolicy::STRICT )
+    {
+        for (int i = 0; i < SM_ENGINE_PRIORITY_LANES; i++)
+        {
+            if ( ready[i] > 0 )
+            {
+                // Pick up the events, which have arrived to higher priority lanes
+                // while lower priority lane was being served
+                for (int j = 0; j < i; j++)
+                {
+                    ready[j] = m_lanes[j].queue.size();
+                    if ( ready[j] > 0 )
+                    {
+                        return j;
+                    }
+                }
+                return i;
+            }
+        }
+        return -1;
+    }
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (int i = 0; i < SM_ENGINE_PRIORITY_LANES; i++)
+        {
+            if ( ready[i] > 0 && credit[i] > 0 )
+            {
+                credit[i]--;
+                return i;
+            }
+        }
+        for (int i = 0; i < SM_ENGINE_PRIORITY_LANES; i++)
+        {
+            credit[i] = m_lanes[i].weight;
+        }
+    }
+    return -1;
+}
+
+void ISmEngine::wakeUp()
+{
+#if SM_ENGINE_MULTITHREAD
+    // Pairs with the fence in waitForNextEvent(): either consumer sees the new
+    // event, or producer sees the consumer sleeping and wakes it up.
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+    if ( m_waiting.load( std::memory_order_relaxed ) )
+    {
+        signal();
+    }
+#else
+    // Single thread engine never sleeps between the events, only external driver needs to know
+    if ( m_notifier != nullptr )
+    {
+        m_notifier( this, m_notifierArg );
+    }
+#endif
 }
 
-bool ISmEngine::sendEvent(SEventData event, uint32_t ms)
+void ISmEngine::signal()
 {
-    __SDeferredEventData ev =
-    {
-        .event = event,
-        .micros = ms * 1000
-    };
 #if SM_ENGINE_MULTITHREAD
-    std::unique_lock<std::mutex> lock(m_mutex);
-#endif
-    if ( m_events.size() >= MAX_APP_QUEUE_SIZE )
+    if ( m_notifier != nullptr )
     {
-        ESP_LOGE( TAG, "Failed to put new event: %02X", event.event );
-        return false;
+        m_notifier( this, m_notifierArg );
+        return;
     }
-    ESP_LOGI( TAG, "New event arrived: %02X", event.event );
-    m_events.push_back( ev );
-#if SM_ENGINE_MULTITHREAD
+#if SM_ENGINE_POLL_FD
+    if ( m_eventFd >= 0 )
+    {
+        uint64_t value = 1;
+        ssize_t result = write( m_eventFd, &value, sizeof(value) );
+        (void)result;
+        return;
+    }
+#endif
+    std::unique_lock<std::mutex> lock(m_mutex);
     m_cond.notify_one();
 #endif
-    return true;
 }
 
 void ISmEngine::loop(uint32_t eventWaitTimeoutMs)
@@ -93,14 +672,64 @@ void ISmEngine::loop(uint32_t eventWaitTimeoutMs)
     }
 }
 
-EEventResult ISmEngine::processAppEvent(SEventData &event)
+STransitionData ISmEngine::findTransition(SEventData event)
 {
-    ESP_LOGD( TAG, "Processing event: %02X", event.event );
     STransitionData status = onEvent( event );
     if ( status.result == EEventResult::NOT_PROCESSED && m_active )
     {
         status = m_active->onEvent( event );
     }
+    return status;
+}
+
+void ISmEngine::setTransitionCache(int size)
+{
+    delete[] m_cache;
+    m_cache = nullptr;
+    m_cacheMask = 0;
+    if ( size > 0 )
+    {
+        uint32_t entries = 1;
+        while ( entries < static_cast<uint32_t>( size ) )
+        {
+            entries <<= 1;
+        }
+        m_cache = new CachedTransition[entries]();
+        m_cacheMask = entries - 1;
+    }
+}
+
+EEventResult ISmEngine::processAppEvent(SEventData &event)
+{
+    ESP_LOGD( TAG, "Processing event: %02X", event.event );
+    if ( m_interestPolicy != EInterestPolicy::KEEP && !isInterested( event.event ) )
+    {
+        m_uninterested++;
+        ESP_LOGI( TAG, "Event skipped, active state is not interested: %02X", event.event );
+        return EEventResult::NOT_PROCESSED;
+    }
+    STransitionData status;
+    if ( m_cache && m_active && isPure() && m_active->isPure() )
+    {
+        uint64_t key = (static_cast<uint64_t>( event.arg ) * 0x9E3779B97F4A7C15ULL) ^
+                       (static_cast<uint64_t>( m_activeId ) << 8 | event.event) * 0xC2B2AE3D27D4EB4FULL;
+        CachedTransition &entry = m_cache[(key >> 32) & m_cacheMask];
+        if ( entry.valid && entry.state == m_activeId && entry.event == event.event && entry.arg == event.arg )
+        {
+            m_cacheHits++;
+            status = entry.result;
+        }
+        else
+        {
+            m_cacheMisses++;
+            status = findTransition( event );
+            entry = { event.arg, m_activeId, event.event, true, status };
+        }
+    }
+    else
+    {
+        status = findTransition( event );
+    }
     ESP_LOGD( TAG, "Processing result 1: %02X", static_cast<uint8_t>(status.result) );
     if ( status.result == EEventResult::NOT_PROCESSED )
     {
@@ -120,43 +749,427 @@ EEventResult ISmEngine::processAppEvent(SEventData &event)
     return status.result;
 }
 
+void ISmEngine::setWaitStrategy( EWaitStrategy strategy, uint32_t spinCount )
+{
+#if SM_ENGINE_MULTITHREAD
+    m_waitStrategy = strategy;
+    m_spinCount = spinCount ? spinCount : 1;
+    m_spinBudget = m_spinCount;
+#else
+    (void)strategy;
+    (void)spinCount;
+#endif
+}
+
+#if SM_ENGINE_MULTITHREAD
+static inline void cpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    asm volatile( "yield" );
+#endif
+}
+
+bool ISmEngine::spinForNextEvent(uint64_t deadline, uint32_t spins, bool yield)
+{
+    for (uint32_t i = 0; ; i++)
+    {
+        if ( hasEvents() || m_stopped || m_nextDeadline < deadline )
+        {
+            return true;
+        }
+        if ( i >= spins )
+        {
+            if ( !yield )
+            {
+                return false;
+            }
+            std::this_thread::yield();
+        }
+        else
+        {
+            cpuRelax();
+        }
+        // Reading clock is expensive, so check the deadline only periodically
+        if ( (i & 63) == 63 && getMicros() >= deadline )
+        {
+            return true;
+        }
+    }
+}
+#endif
+
 void ISmEngine::waitForNextEvent()
 {
 #if SM_ENGINE_MULTITHREAD
+    // Engine with pollable handles or notifier sleeps in external event loop only
+    if ( hasEvents() || m_eventWaitTimeoutMs == 0 || m_stopped || m_external )
+    {
+        return;
+    }
+    uint64_t now = getMicros();
+    uint64_t deadline = m_eventWaitTimeoutMs == SM_WAIT_FOREVER ? UINT64_MAX :
+                        now + static_cast<uint64_t>( m_eventWaitTimeoutMs ) * 1000;
+    if ( m_stateDeadline < deadline )
+    {
+        deadline = m_stateDeadline;
+    }
+    if ( m_nextDeadline < deadline )
+    {
+        deadline = m_nextDeadline;
+    }
+    if ( deadline <= now )
+    {
+        return;
+    }
+    switch ( m_waitStrategy )
+    {
+        case EWaitStrategy::BUSY_SPIN:
+            spinForNextEvent( deadline, UINT32_MAX, false );
+            return;
+        case EWaitStrategy::SPIN_YIELD:
+            spinForNextEvent( deadline, m_spinCount, true );
+            return;
+        case EWaitStrategy::SPIN_PARK:
+            // Spin longer while the events arrive during spinning, and shorter,
+            // if the engine has to sleep anyway
+            if ( spinForNextEvent( deadline, m_spinBudget, false ) )
+            {
+                m_spinBudget = m_spinBudget * 2 < m_spinCount ? m_spinBudget * 2 : m_spinCount;
+                return;
+            }
+            m_spinBudget = m_spinBudget > 1 ? m_spinBudget / 2 : 1;
+            break;
+        default:
+            break;
+    }
     std::unique_lock<std::mutex> lock( m_mutex );
-    m_cond.wait_for( lock, std::chrono::milliseconds( m_eventWaitTimeoutMs ),
-                     [this]()->bool{ return m_events.size() > 0; } );
+    m_waiting.store( true, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+    // New timer, started by other thread, can be earlier than the deadline
+    auto ready = [this, deadline]()->bool
+    {
+        return hasEvents() || m_stopped || m_nextDeadline < deadline;
+    };
+    if ( deadline == UINT64_MAX )
+    {
+        m_cond.wait( lock, ready );
+    }
+    else
+    {
+        m_cond.wait_for( lock, std::chrono::microseconds( deadline - now ), ready );
+    }
+    m_waiting.store( false, std::memory_order_relaxed );
+#endif
+}
+
+
+bool ISmEngine::enablePollFds()
+{
+#if SM_ENGINE_POLL_FD
+    if ( m_eventFd < 0 )
+    {
+        m_eventFd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+    }
+    if ( m_timerFd < 0 )
+    {
+        m_timerFd = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC );
+    }
+    if ( m_eventFd < 0 || m_timerFd < 0 )
+    {
+        ESP_LOGE( TAG, "Failed to create pollable handles" );
+        return false;
+    }
+    // Engine is considered sleeping outside processReady(), so producers signal eventfd
+    m_external = true;
+    sleepExternally();
+    return true;
+#else
+    return false;
+#endif
+}
+
+void ISmEngine::setNotifier(TSmeNotifyFunction func, void *arg)
+{
+    m_notifier = func;
+    m_notifierArg = arg;
+    m_external = func != nullptr;
+    if ( m_external )
+    {
+        sleepExternally();
+    }
+}
+
+uint64_t ISmEngine::getNextDeadline()
+{
+    uint64_t deadline = m_nextDeadline;
+    if ( m_stateDeadline < deadline )
+    {
+        deadline = m_stateDeadline;
+    }
+    if ( m_eventWaitTimeoutMs != 0 && m_eventWaitTimeoutMs != SM_WAIT_FOREVER )
+    {
+        uint64_t next = getMicros() + static_cast<uint64_t>( m_eventWaitTimeoutMs ) * 1000;
+        if ( next < deadline )
+        {
+            deadline = next;
+        }
+    }
+    return deadline;
+}
+
+void ISmEngine::sleepExternally()
+{
+#if SM_ENGINE_POLL_FD
+    if ( m_timerFd >= 0 )
+    {
+        uint64_t deadline = getNextDeadline();
+        uint64_t now = getMicros();
+        // Relative timeout is used, since getMicros() can be overridden. Zero value disarms timer
+        struct itimerspec spec{};
+        if ( deadline != UINT64_MAX )
+        {
+            uint64_t us = deadline > now ? deadline - now : 1;
+            spec.it_value.tv_sec = us / 1000000;
+            spec.it_value.tv_nsec = (us % 1000000) * 1000;
+        }
+        timerfd_settime( m_timerFd, 0, &spec, nullptr );
+    }
+#endif
+#if SM_ENGINE_MULTITHREAD
+    // Pairs with the fence in wakeUp(): events, which arrived during processReady(),
+    // must signal again
+    m_waiting.store( true, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+    if ( hasEvents() )
+    {
+        signal();
+    }
+#else
+    // Events, left by the batch limit, need another processReady() call
+    if ( hasEvents() )
+    {
+        wakeUp();
+    }
+#endif
+}
+
+void ISmEngine::hibernate(SmEngineSnapshot &snapshot)
+{
+    uint64_t now = getMicros();
+    snapshot.timestamp = now;
+    snapshot.active = m_activeId;
+    snapshot.stack.clear();
+    sme::stack<ISmeState*> stack = m_stack;
+    while ( !stack.empty() )
+    {
+        StateUid id = stack.top() ? stack.top()->getId() : SM_STATE_NONE;
+        snapshot.stack.push_back( id );
+        stack.pop();
+    }
+    // The stack is read from the top, restore original order
+    for (int i = 0, j = static_cast<int>( snapshot.stack.size() ) - 1; i < j; i++, j--)
+    {
+        StateUid id = snapshot.stack[i];
+        snapshot.stack[i] = snapshot.stack[j];
+        snapshot.stack[j] = id;
+    }
+    snapshot.stateElapsed = now - m_stateStartTs;
+    snapshot.stateTimeout = UINT64_MAX;
+    snapshot.timers.clear();
+    {
+#if SM_ENGINE_MULTITHREAD
+        std::unique_lock<std::mutex> lock( m_timerMutex );
+#endif
+        m_timers.forEach( [this, now, &snapshot](const SmTimerRecord &timer)
+        {
+            uint64_t remaining = timer.deadline > now ? timer.deadline - now : 0;
+            if ( timer.handle == m_stateTimer )
+            {
+                snapshot.stateTimeout = remaining;
+                return;
+            }
+            SmTimerRecord record = timer;
+            record.deadline = remaining;
+            record.handle = SM_TIMER_INVALID;
+            snapshot.timers.push_back( record );
+        } );
+        m_timers.saveGenerations( snapshot.timerGenerations );
+        m_timers.restoreGenerations( snapshot.timerGenerations );
+        m_nextDeadline = UINT64_MAX;
+    }
+    m_stateTimer = SM_TIMER_INVALID;
+    snapshot.events.clear();
+    SEventData event;
+    for (auto &lane: m_lanes)
+    {
+        while ( lane.queue.pop( event ) )
+        {
+            if ( isCoalesced( event.event ) )
+            {
+                takeCoalesced( event );
+            }
+            snapshot.events.push_back( event );
+        }
+    }
+    m_active = nullptr;
+    m_activeInterest = nullptr;
+    m_engineInterest = nullptr;
+    m_activeId = SM_STATE_NONE;
+    // Hibernated engine can be destroyed without end(), it releases shared states now
+    CurrentScope scope( this );
+    for (const SmStateInfo *state = m_states; state->state != nullptr; state++)
+    {
+        if ( state->state->isShared() && state->state->removeUser() )
+        {
+            state->state->end();
+        }
+    }
+}
+
+bool ISmEngine::resume(const SmEngineSnapshot &snapshot)
+{
+    ISmeState *active = getById( snapshot.active );
+    if ( active == nullptr )
+    {
+        ESP_LOGE( TAG, "Failed to resume state 0x%02X, state not found", snapshot.active );
+        return false;
+    }
+    while ( !m_stack.empty() )
+    {
+        m_stack.pop();
+    }
+    for (int i = 0; i < static_cast<int>( snapshot.stack.size() ); i++)
+    {
+        m_stack.push( getById( snapshot.stack[i] ) );
+    }
+    m_active = active;
+    m_activeInterest = active->getEventInterest();
+    m_engineInterest = getStateInterest( snapshot.active );
+    m_activeId = snapshot.active;
+    // Time keeps going during hibernation, so deadlines are restored relative to its moment
+    m_stateStartTs = snapshot.timestamp - snapshot.stateElapsed;
+    m_stateDeadline = UINT64_MAX;
+    {
+#if SM_ENGINE_MULTITHREAD
+        std::unique_lock<std::mutex> lock( m_timerMutex );
 #endif
+        m_timers.restoreGenerations( snapshot.timerGenerations );
+        for (int i = 0; i < static_cast<int>( snapshot.timers.size() ); i++)
+        {
+            const SmTimerRecord &timer = snapshot.timers[i];
+            m_timers.add( timer.event, snapshot.timestamp + timer.deadline, timer.bound, timer.period, timer.policy );
+        }
+        if ( snapshot.stateTimeout != UINT64_MAX )
+        {
+            m_stateTimer = m_timers.add( { SM_EVENT_TIMEOUT, static_cast<uintptr_t>( m_active->getTimeout() ) * 1000 },
+                                         snapshot.timestamp + snapshot.stateTimeout );
+        }
+        uint64_t deadline = UINT64_MAX;
+        m_timers.getNextDeadline( deadline );
+        m_nextDeadline = deadline;
+    }
+    for (int i = 0; i < static_cast<int>( snapshot.events.size() ); i++)
+    {
+        sendEvent( snapshot.events[i] );
+    }
+    wakeUp();
+    return true;
 }
 
+void ISmEngine::processReady()
+{
+#if SM_ENGINE_MULTITHREAD
+    m_consumerThread.store( std::this_thread::get_id(), std::memory_order_relaxed );
+    if ( m_external )
+    {
+        m_waiting.store( false, std::memory_order_relaxed );
+    }
+#endif
+#if SM_ENGINE_POLL_FD
+    if ( m_eventFd >= 0 )
+    {
+        uint64_t value;
+        ssize_t result = read( m_eventFd, &value, sizeof(value) );
+        result = read( m_timerFd, &value, sizeof(value) );
+        (void)result;
+    }
+#endif
+    onUpdate();
+    dispatchEvents();
+    if ( m_external )
+    {
+        sleepExternally();
+    }
+}
 
 void ISmEngine::update()
 {
+#if SM_ENGINE_MULTITHREAD
+    m_consumerThread.store( std::this_thread::get_id(), std::memory_order_relaxed );
+#endif
     onUpdate();
 
     waitForNextEvent();
 
-    uint32_t ts = getMicros();
-    uint32_t delta = static_cast<uint32_t>( ts - m_lastUpdateTimeMs );
-    m_lastUpdateTimeMs = ts;
+    dispatchEvents();
+}
 
-    auto it = m_events.begin();
-    while ( it != m_events.end() )
+void ISmEngine::dispatchEvents()
+{
+    CurrentScope scope( this );
+    uint64_t ts = getMicros();
+    // Take snapshot of ready events, so the batch is not extended by the events,
+    // sent by the handlers
+    int ready[SM_ENGINE_PRIORITY_LANES];
+    int credit[SM_ENGINE_PRIORITY_LANES];
+    for (int i = 0; i < SM_ENGINE_PRIORITY_LANES; i++)
+    {
+        ready[i] = m_lanes[i].queue.size();
+        credit[i] = m_lanes[i].weight;
+    }
+    int budget = m_maxBatchSize > 0 ? m_maxBatchSize : INT_MAX;
+    int drained = 0;
+    SEventData event;
+    // Timers are popped one by one, since any handler can cancel pending timers
+    while ( budget > 0 && popExpiredTimer( ts, event ) )
+    {
+        processAppEvent( event );
+        budget--;
+    }
+    while ( budget > 0 )
     {
-        if ( it->micros <= delta )
+        int lane = nextLane( ready, credit );
+        if ( lane < 0 )
         {
-            processAppEvent( it->event );
-#if SM_ENGINE_MULTITHREAD
-            std::unique_lock<std::mutex> lock( m_mutex );
-#endif
-            it = m_events.erase( it );
+            break;
         }
-        else
+        if ( !m_lanes[lane].queue.pop( event ) )
+        {
+            ready[lane] = 0;
+            continue;
+        }
+        ready[lane]--;
+        drained++;
+        if ( isCoalesced( event.event ) )
         {
-            it->micros -= delta;
-            it++;
+            takeCoalesced( event );
         }
+        if ( isFiltered( event.event ) && !filterEvent( event, ts ) )
+        {
+            ESP_LOGI( TAG, "Event filtered: %02X", event.event );
+            continue;
+        }
+        processAppEvent( event );
+        budget--;
+    }
+    if ( drained > 0 )
+    {
+        notifySpace();
     }
+    // Active state reports its timeouts again during update()
+    m_stateDeadline = UINT64_MAX;
     if (m_active)
         m_active->update();
     else
@@ -174,13 +1187,18 @@ void ISmEngine::onUpdate()
 
 bool ISmEngine::begin()
 {
+    CurrentScope scope( this );
     bool result = onBegin();
+    buildStateIndex();
     if ( result )
     {
         const SmStateInfo * state = m_states;
         while ( state->state != nullptr )
         {
-            result = state->state->begin();
+            if ( !state->state->isShared() || state->state->addUser() )
+            {
+                result = state->state->begin();
+            }
             if ( !result )
             {
                 break;
@@ -188,13 +1206,13 @@ bool ISmEngine::begin()
             state++;
         }
     }
-    m_lastUpdateTimeMs = getMicros();
     m_stopped = false;
     return result;
 }
 
 bool ISmEngine::begin( StateUid id )
 {
+    CurrentScope scope( this );
     bool result = begin();
     if ( result )
     {
@@ -210,14 +1228,19 @@ bool ISmEngine::onBegin()
 
 void ISmEngine::end()
 {
+    CurrentScope scope( this );
     if (m_active)
     {
         m_active->exit( nullptr );
+        cancelStateTimeout();
     }
     const SmStateInfo * state = m_states;
     while ( state->state != nullptr )
     {
-        state->state->end();
+        if ( !state->state->isShared() || state->state->removeUser() )
+        {
+            state->state->end();
+        }
         state++;
     };
     onEnd();
@@ -229,6 +1252,12 @@ void ISmEngine::onEnd()
 
 ISmeState *ISmEngine::getById(StateUid id)
 {
+#if SM_ENGINE_STATE_INDEX
+    if ( m_stateIndex )
+    {
+        return id < m_stateIndexSize ? m_stateIndex[id] : nullptr;
+    }
+#endif
     const SmStateInfo * state = m_states;
     while ( state->state != nullptr )
     {
@@ -241,6 +1270,42 @@ ISmeState *ISmEngine::getById(StateUid id)
     return nullptr;
 }
 
+void ISmEngine::buildStateIndex()
+{
+#if SM_ENGINE_STATE_INDEX
+    dropStateIndex();
+    int size = 0;
+    for (const SmStateInfo *state = m_states; state->state != nullptr; state++)
+    {
+        StateUid id = state->state->getId();
+        if ( id != SM_STATE_NONE && id >= size )
+        {
+            size = id + 1;
+        }
+    }
+    m_stateIndex = new ISmeState *[size + 1]();
+    m_stateIndexSize = size;
+    // The first state with the id wins, the same as in linear search
+    for (const SmStateInfo *state = m_states; state->state != nullptr; state++)
+    {
+        StateUid id = state->state->getId();
+        if ( id != SM_STATE_NONE && m_stateIndex[id] == nullptr )
+        {
+            m_stateIndex[id] = state->state;
+        }
+    }
+#endif
+}
+
+void ISmEngine::dropStateIndex()
+{
+#if SM_ENGINE_STATE_INDEX
+    delete[] m_stateIndex;
+    m_stateIndex = nullptr;
+    m_stateIndexSize = 0;
+#endif
+}
+
 bool ISmEngine::switchState(StateUid id, SEventData *event)
 {
     if ( id == SM_STATE_NONE )
@@ -250,26 +1315,43 @@ bool ISmEngine::switchState(StateUid id, SEventData *event)
     ISmeState * newState = getById( id );
     if ( newState )
     {
-        if ( m_active )
-        {
-            if ( m_active->getId() == id )
-            {
-                return false;
-            }
-            m_active->exit(event);
-        }
-        ESP_LOGI(TAG, "Switching to state %s", newState->getName());
-        m_active = newState;
-
-        m_stateStartTs = getMicros();
-        m_active->enter( event );
-        m_activeId = id;
-        return true;
+        return switchState( newState, event );
     }
     ESP_LOGE(TAG, "Switching to state 0x%02X failed, state not found", id);
     return false;
 }
 
+bool ISmEngine::switchState(ISmeState *newState, SEventData *event)
+{
+    if ( m_active )
+    {
+        if ( m_active == newState )
+        {
+            return false;
+        }
+        m_active->exit(event);
+        cancelStateTimeout();
+        if ( m_cancelTimersOnExit )
+        {
+#if SM_ENGINE_MULTITHREAD
+            std::unique_lock<std::mutex> lock( m_timerMutex );
+#endif
+            m_timers.cancelBound();
+        }
+    }
+    ESP_LOGI(TAG, "Switching to state %s", newState->getName());
+    m_active = newState;
+    m_activeInterest = newState->getEventInterest();
+    m_engineInterest = getStateInterest( newState->getId() );
+
+    m_stateStartTs = getMicros();
+    m_stateDeadline = UINT64_MAX;
+    m_active->enter( event );
+    m_activeId = newState->getId();
+    armStateTimeout();
+    return true;
+}
+
 bool ISmEngine::pushState(StateUid newState, SEventData *event)
 {
     m_stack.push(m_active);
@@ -293,7 +1375,7 @@ bool ISmEngine::popState(SEventData *event)
     {
         auto state = m_stack.top();
         m_stack.pop();
-        result = switchState( state->getId(), event );
+        result = switchState( state, event );
         if (!result)
         {
             m_stack.push(state);
@@ -309,7 +1391,7 @@ bool ISmEngine::popState(SEventData *event)
 uint64_t ISmEngine::getMicros()
 {
 #if SM_ENGINE_USE_STL
-    return std::chrono::time_point_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now()).time_since_epoch().count();
+    return std::chrono::time_point_cast<std::chrono::microseconds>(std::chrono::steady_clock::now()).time_since_epoch().count();
 #else
     return 0;
 #endif
@@ -318,6 +1400,11 @@ uint64_t ISmEngine::getMicros()
 bool ISmEngine::timeoutEvent(uint64_t timeout, bool generateEvent)
 {
     bool event = static_cast<uint64_t>( getMicros() - m_stateStartTs ) >= timeout;
+    if ( !event && m_stateStartTs + timeout < m_stateDeadline )
+    {
+        // Tickless loop wakes up, when the timeout expires
+        m_stateDeadline = m_stateStartTs + timeout;
+    }
     if ( event && generateEvent )
     {
          sendEvent( { SM_EVENT_TIMEOUT, static_cast<uintptr_t>(timeout) } );
@@ -328,6 +1415,12 @@ bool ISmEngine::timeoutEvent(uint64_t timeout, bool generateEvent)
 void ISmEngine::resetTimeout()
 {
     m_stateStartTs = getMicros();
+    m_stateDeadline = UINT64_MAX;
+    if ( m_active )
+    {
+        cancelStateTimeout();
+        armStateTimeout();
+    }
 }
 
 
@@ -0,0 +1,116 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2020, Aleksei Dynda
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "sme/scan_table.h"
+
+static inline bool argMatches(const SmRowScan &scan, int index, uintptr_t arg)
+{
+    return ((scan.anyArg[index / 32] >> (index % 32)) & 1) || scan.args[index] == arg;
+}
+
+static int scanScalar(const SmRowScan &scan, StateUid sid, SEventData event)
+{
+    for (int i = 0; i < scan.count; i++)
+    {
+        if ( scan.events[i] == event.event &&
+             (scan.sources[i] == sid || scan.sources[i] == SM_STATE_ANY) &&
+             argMatches( scan, i, event.arg ) )
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+#if SM_SCAN_AVX2
+__attribute__((target("avx2")))
+static int scanAvx2(const SmRowScan &scan, StateUid sid, SEventData event)
+{
+    const __m256i eventId = _mm256_set1_epi8( static_cast<char>( event.event ) );
+    const __m256i state = _mm256_set1_epi8( static_cast<char>( sid ) );
+    const __m256i any = _mm256_set1_epi8( static_cast<char>( SM_STATE_ANY ) );
+    const __m256i tag = _mm256_set1_epi8( static_cast<char>( sme::argTag( event.arg ) ) );
+    for (int base = 0; base < scan.count; base += 32)
+    {
+        __m256i events = _mm256_load_si256( reinterpret_cast<const __m256i *>( scan.events + base ) );
+        __m256i sources = _mm256_load_si256( reinterpret_cast<const __m256i *>( scan.sources + base ) );
+        __m256i tags = _mm256_load_si256( reinterpret_cast<const __m256i *>( scan.argTags + base ) );
+        __m256i match = _mm256_and_si256( _mm256_cmpeq_epi8( events, eventId ),
+                                          _mm256_or_si256( _mm256_cmpeq_epi8( sources, state ),
+                                                           _mm256_cmpeq_epi8( sources, any ) ) );
+        uint32_t mask = static_cast<uint32_t>( _mm256_movemask_epi8( match ) );
+        // Rows with any argument or with the same argument hash
+        mask &= static_cast<uint32_t>( _mm256_movemask_epi8( _mm256_cmpeq_epi8( tags, tag ) ) ) | scan.anyArg[base / 32];
+        // Padding rows of the last block
+        if ( scan.count - base < 32 )
+        {
+            mask &= (1u << (scan.count - base)) - 1;
+        }
+        // Hashes of different arguments can be equal, so arguments are checked too
+        while ( mask )
+        {
+            int index = base + __builtin_ctz( mask );
+            if ( argMatches( scan, index, event.arg ) )
+            {
+                return index;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return -1;
+}
+#endif
+
+static bool detectAvx2()
+{
+#if SM_SCAN_AVX2
+    __builtin_cpu_init();
+    // Table scans use tzcnt from BMI1 too
+    return __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "bmi" );
+#else
+    return false;
+#endif
+}
+
+// Tables, used before this initializer runs, take the scalar path
+const bool sme::scanHasAvx2 = detectAvx2();
+
+int sme::scanRows(const SmRowScan &scan, StateUid sid, SEventData event)
+{
+#if SM_SCAN_AVX2
+    if ( scanHasAvx2 )
+    {
+        return scanAvx2( scan, sid, event );
+    }
+#endif
+    return scanScalar( scan, sid, event );
+}
@@ -0,0 +1,331 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2020, Aleksei Dynda
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "sme/timer_queue.h"
+
+static inline SmTimerHandle makeHandle(uint16_t slot, uint16_t gen)
+{
+    return (static_cast<uint32_t>( gen ) << 16) | slot;
+}
+
+SmTimerHandle SmTimerQueue::add(SEventData event, uint64_t deadline, bool bound,
+                                uint64_t period, ETimerPolicy policy)
+{
+    // Stale entries are dropped lazily, get rid of them if they start to dominate
+    if ( m_stale > m_count + 16 )
+    {
+        compact();
+    }
+    uint16_t index;
+    if ( !allocSlot( index ) )
+    {
+        compact();
+        if ( !allocSlot( index ) )
+        {
+            return SM_TIMER_INVALID;
+        }
+    }
+    Slot &slot = m_slots[index];
+    slot.event = event;
+    slot.epoch = bound ? m_epoch : 0;
+    slot.period = period;
+    slot.policy = policy;
+    Entry entry =
+    {
+        .deadline = deadline,
+        .slot = index,
+        .gen = slot.gen
+    };
+    int count = heapSize();
+    m_heap.push_back( entry );
+    if ( heapSize() == count )
+    {
+        freeSlot( index );
+        return SM_TIMER_INVALID;
+    }
+    siftUp( count );
+    return makeHandle( index, entry.gen );
+}
+
+bool SmTimerQueue::cancel(SmTimerHandle handle)
+{
+    uint16_t index = handle & 0xFFFF;
+    uint16_t gen = handle >> 16;
+    if ( handle == SM_TIMER_INVALID || index >= m_slots.size() || m_slots[index].gen != gen )
+    {
+        return false;
+    }
+    bool result = m_slots[index].epoch == 0 || m_slots[index].epoch == m_epoch;
+    freeSlot( index );
+    m_stale++;
+    return result;
+}
+
+void SmTimerQueue::cancelBound()
+{
+    if ( ++m_epoch == 0 )
+    {
+        m_epoch = 1;
+    }
+}
+
+void SmTimerQueue::saveGenerations(sme::vector<uint16_t> &gens) const
+{
+    gens.clear();
+    // Slots of pending timers are saved as freed, their handles must not match new timers
+    for (int i = 0; i < static_cast<int>( m_slots.size() ); i++)
+    {
+        uint16_t gen = m_slots[i].gen + 1;
+        if ( gen == 0 )
+        {
+            gen = 1;
+        }
+        gens.push_back( gen );
+    }
+    for (uint16_t i = m_free; i != UINT16_MAX; i = m_slots[i].next)
+    {
+        gens[i] = m_slots[i].gen;
+    }
+}
+
+void SmTimerQueue::restoreGenerations(const sme::vector<uint16_t> &gens)
+{
+    m_heap.clear();
+    m_slots.clear();
+    m_free = UINT16_MAX;
+    m_epoch = 1;
+    m_count = 0;
+    m_stale = 0;
+    for (int i = 0; i < static_cast<int>( gens.size() ); i++)
+    {
+        Slot slot = { };
+        slot.gen = gens[i];
+        m_slots.push_back( slot );
+    }
+    // Lower slots are allocated first
+    for (int i = static_cast<int>( m_slots.size() ) - 1; i >= 0; i--)
+    {
+        m_slots[i].next = m_free;
+        m_free = static_cast<uint16_t>( i );
+    }
+}
+
+bool SmTimerQueue::getNextDeadline(uint64_t &deadline)
+{
+    while ( heapSize() > 0 && isStale( m_heap[0] ) )
+    {
+        removeTop();
+    }
+    if ( heapSize() == 0 )
+    {
+        return false;
+    }
+    deadline = m_heap[0].deadline;
+    return true;
+}
+
+bool SmTimerQueue::popExpired(uint64_t now, SEventData &event)
+{
+    uint64_t deadline;
+    while ( getNextDeadline( deadline ) && deadline <= now )
+    {
+        event = m_slots[m_heap[0].slot].event;
+        if ( m_slots[m_heap[0].slot].period == 0 )
+        {
+            removeTop();
+            return true;
+        }
+        if ( rescheduleTop( now ) )
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SmTimerQueue::rescheduleTop(uint64_t now)
+{
+    Entry &top = m_heap[0];
+    const Slot &slot = m_slots[top.slot];
+    // Next deadlines are calculated from the original ones, so the timer doesn't drift
+    uint64_t missed = (now - top.deadline) / slot.period;
+    bool fire = true;
+    switch ( slot.policy )
+    {
+        case ETimerPolicy::CATCH_UP:
+            top.deadline += slot.period;
+            break;
+        case ETimerPolicy::COALESCE:
+            top.deadline += slot.period * (missed + 1);
+            break;
+        case ETimerPolicy::SKIP:
+        default:
+            fire = missed == 0;
+            top.deadline += slot.period * (missed + 1);
+            break;
+    }
+    siftDown( 0 );
+    return fire;
+}
+
+bool SmTimerQueue::isStale(const Entry &entry) const
+{
+    const Slot &slot = m_slots[entry.slot];
+    return slot.gen != entry.gen || ( slot.epoch != 0 && slot.epoch != m_epoch );
+}
+
+bool SmTimerQueue::allocSlot(uint16_t &index)
+{
+    if ( m_free != UINT16_MAX )
+    {
+        index = m_free;
+        m_free = m_slots[index].next;
+    }
+    else
+    {
+        int count = m_slots.size();
+        if ( count >= UINT16_MAX )
+        {
+            return false;
+        }
+        Slot slot = { };
+        slot.gen = 1;
+        m_slots.push_back( slot );
+        if ( static_cast<int>( m_slots.size() ) == count )
+        {
+            return false;
+        }
+        index = static_cast<uint16_t>( count );
+    }
+    m_count++;
+    return true;
+}
+
+void SmTimerQueue::freeSlot(uint16_t index)
+{
+    Slot &slot = m_slots[index];
+    if ( ++slot.gen == 0 )
+    {
+        slot.gen = 1;
+    }
+    slot.next = m_free;
+    m_free = index;
+    m_count--;
+}
+
+void SmTimerQueue::removeTop()
+{
+    const Entry &top = m_heap[0];
+    if ( m_slots[top.slot].gen == top.gen )
+    {
+        // slot is still owned by the entry: either fired or cancelled by epoch
+        freeSlot( top.slot );
+    }
+    else
+    {
+        m_stale--;
+    }
+    m_heap[0] = m_heap.back();
+    m_heap.pop_back();
+    siftDown( 0 );
+}
+
+void SmTimerQueue::compact()
+{
+    int count = 0;
+    for (int i = 0; i < heapSize(); i++)
+    {
+        Entry entry = m_heap[i];
+        if ( !isStale( entry ) )
+        {
+            m_heap[count++] = entry;
+        }
+        else if ( m_slots[entry.slot].gen == entry.gen )
+        {
+            freeSlot( entry.slot );
+        }
+    }
+    while ( heapSize() > count )
+    {
+        m_heap.pop_back();
+    }
+    m_stale = 0;
+    for (int i = count / 2 - 1; i >= 0; i--)
+    {
+        siftDown( i );
+    }
+}
+
+void SmTimerQueue::siftUp(int index)
+{
+    Entry entry = m_heap[index];
+    while ( index > 0 )
+    {
+        int parent = (index - 1) / 2;
+        if ( m_heap[parent].deadline <= entry.deadline )
+        {
+            break;
+        }
+        m_heap[index] = m_heap[parent];
+        index = parent;
+    }
+    m_heap[index] = entry;
+}
+
+void SmTimerQueue::siftDown(int index)
+{
+    int count = heapSize();
+    if ( index >= count )
+    {
+        return;
+    }
+    Entry entry = m_heap[index];
+    for (;;)
+    {
+        int child = index * 2 + 1;
+        if ( child >= count )
+        {
+            break;
+        }
+        if ( child + 1 < count && m_heap[child + 1].deadline < m_heap[child].deadline )
+        {
+            child++;
+        }
+        if ( entry.deadline <= m_heap[child].deadline )
+        {
+            break;
+        }
+        m_heap[index] = m_heap[child];
+        index = child;
+    }
+    m_heap[index] = entry;
+}
@@ -35,10 +35,23 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <stdio.h>
 #include <string.h>
 #include <thread>
+#include <chrono>
+#include <vector>
 
 #include "sme/engine.h"
 #include "sme/generic_state.h"
 #include "sme/generic_state_engine.h"
+#include "sme/event_buffer.h"
+#include "sme/executor.h"
+#include "sme/engine_registry.h"
+#include "sme/fleet.h"
+#include "sme/dense_table.h"
+#include "sme/hash_table.h"
+#include "sme/scan_table.h"
+#include "sme/static_engine.h"
+#if SM_ENGINE_POLL_FD
+#include <poll.h>
+#endif
 
 TEST_GROUP(ST)
 {
@@ -111,6 +124,11 @@ static C_TRANSITION_TBL(state3Table)
     TRANSITION_TBL_END
 }
 
+SM_PURE_TABLE(masterTable)
+SM_PURE_TABLE(state1Table)
+SM_PURE_TABLE(state2Table)
+SM_PURE_TABLE(state3Table)
+
 void state1_do_work()
 {
 }
@@ -240,3 +258,1669 @@ TEST(ST, checkMasterTable)
     CHECK_EQUAL( STATE_3, sm.getActiveId() );
     sm.end();
 }
+
+static int s_received = 0;
+
+static C_TRANSITION_TBL(countTable)
+{
+    NO_TRANSITION(EVENT_1, SM_EVENT_ARG_ANY, s_received++)
+    TRANSITION_TBL_END
+}
+
+TEST(ST, checkQueueCapacity)
+{
+    GenericState<sme::NO_ENTER, sme::NO_UPDATE, sme::NO_EXIT, countTable> state1(STATE_1);
+    SmStateInfo statesList[] =
+    {
+        STATE_LIST_ITEM(state1),
+        STATE_LIST_END,
+    };
+    GenericStateEngine<sme::NO_TABLE> sm(statesList);
+
+    s_received = 0;
+    sm.begin(STATE_1);
+    // Queue size is honoured exactly, though the ring is allocated for 16 events
+    for (int i = 0; i < 10; i++)
+    {
+        CHECK_TRUE( sm.sendEvent( { EVENT_1, 0 } ) );
+    }
+    CHECK_FALSE( sm.sendEvent( { EVENT_1, 0 } ) );
+    sm.update();
+    CHECK_EQUAL( 10, s_received );
+    CHECK_EQUAL( 1, sm.getDroppedEvents( SM_LANE_DEFAULT ) );
+    sm.end();
+}
+
+TEST(ST, checkEngineSize)
+{
+    // Per-event tables are allocated on demand and do not count here
+    CHECK_TRUE( sizeof(ISmEngine) <= 1024 );
+}
+
+TEST(ST, checkMultipleProducers)
+{
+    GenericState<sme::NO_ENTER, sme::NO_UPDATE, sme::NO_EXIT, countTable> state1(STATE_1);
+    SmStateInfo statesList[] =
+    {
+        STATE_LIST_ITEM(state1),
+        STATE_LIST_END,
+    };
+    GenericStateEngine<sme::NO_TABLE> sm(statesList);
+
+    s_received = 0;
+    sm.begin(STATE_1);
+    sm.setWaitEventTimeout( 10 );
+    std::thread producers[4];
+    for (auto &producer: producers)
+    {
+        producer = std::thread([&sm]() {
+            for (int i = 0; i < 1000; i++)
+            {
+                while ( !sm.sendEvent( { EVENT_1, 0 } ) ) std::this_thread::yield();
+            }
+        });
+    }
+    while ( s_received < 4000 )
+    {
+        sm.update();
+    }
+    for (auto &producer: producers)
+    {
+        producer.join();
+    }
+    CHECK_EQUAL( 4000, s_received );
+    sm.end();
+}
+
+class FakeClockEngine: public GenericStateEngine<sme::NO_TABLE>
+{
+public:
+    FakeClockEngine(SmStateInfo *states): GenericStateEngine<sme::NO_TABLE>(states) { }
+
+    uint64_t getMicros() override { return m_now; }
+
+    void advance(uint32_t ms) { m_now += static_cast<uint64_t>( ms ) * 1000; }
+
+    void advanceMicros(uint64_t us) { m_now += us; }
+
+private:
+    uint64_t m_now = 0x100000000ULL;
+};
+
+TEST(ST, checkDeferredEvents)
+{
+    GenericState<sme::NO_ENTER, state1_do_work, sme::NO_EXIT, state1Table> state1(STATE_1);
+    GenericState<sme::NO_ENTER, sme::NO_UPDATE, sme::NO_EXIT, state2Table> state2(STATE_2);
+    GenericState<sme::NO_ENTER, sme::NO_UPDATE, sme::NO_EXIT, state3Table> state3(STATE_3);
+    SmStateInfo statesList[] =
+    {
+        STATE_LIST_ITEM(state1),
+        STATE_LIST_ITEM(state2),
+        STATE_LIST_ITEM(state3),
+        STATE_LIST_END,
+    };
+    FakeClockEngine sm(statesList);
+
+    sm.begin(STATE_1);
+    sm.sendEvent( { EVENT_3, 0 }, 200 );
+    sm.sendEvent( { EVENT_2, 0 }, 100 );
+    sm.update();
+    CHECK_EQUAL( STATE_1, sm.getActiveId() );
+    sm.advance( 99 );
+    sm.update();
+    CHECK_EQUAL( STATE_1, sm.getActiveId() );
+    sm.advance( 1 );
+    sm.update();
+    CHECK_EQUAL( STATE_2, sm.getActiveId() );
+    sm.advance( 100 );
+    sm.update();
+    CHECK_EQUAL( STATE_3, sm.getActiveId() );
+    sm.end();
+}
+
+TEST(ST, checkCancelDeferredEvent)
+{
+    GenericState<sme::NO_ENTER, state1_do_work, sme::NO_EXIT, state1Table> state1(STATE_1);
+    GenericState<sme::NO_ENTER, sme::NO_UPDATE, sme::NO_EXIT, state2Table> state2(STATE_2);
+    GenericState<sme::NO_ENTER, sme::NO_UPDATE, sme::NO_EXIT, state3Table> state3(STATE_3);
+    SmStateInfo statesList[] =
+    {
+        STATE_LIST_ITEM(state1),
+        STATE_LIST_ITEM(state2),
+        STATE_LIST_ITEM(state3),
+        STATE_LIST_END,
+    };
+    FakeClockEngine sm(statesList);
+
+    sm.begin(STATE_1);
+    SmTimerHandle handle = sm.sendEvent( { EVENT_2, 0 }, 100 );
+    sm.sendEvent( { EVENT_3, 0 }, 200 );
+    CHECK( handle != SM_TIMER_INVALID );
+    CHECK_TRUE( sm.cancel( handle ) );
+    CHECK_FALSE( sm.cancel( handle ) );
+    sm.advance( 150 );
+    sm.update();
+    CHECK_EQUAL( STATE_1, sm.getActiveId() );
+    sm.advance( 50 );
+    sm.update();
+    CHECK_EQUAL( STATE_3, sm.getActiveId() );
+    sm.end();
+}
+
+class TimeoutState: public SmState
+{
+public:
+    TimeoutState(): SmState("timeout") {}
+
+    void enter(SEventData *event) override
+    {
+        sendEvent( { EVENT_3, 0 }, 100 );
+    }
+
+    STransitionData onEvent(SEventData event) override
+    {
+        TRANSITION_SWITCH(EVENT_1, 0, sme::NO_FUNC, STATE_2)
+        TRANSITION_SWITCH(EVENT_3, 0, sme::NO_FUNC, STATE_3)
+        TRANSITION_TBL_END
+    }
+};
+
+class TimeoutFsm: public SmEngine
+{
+public:
+    TimeoutFsm(): SmEngine()
+    {
+        m_state1.setId( STATE_1 );
+        addState( m_state1 );
+        addState( m_state2 );
+        addState( m_state3 );
+    }
+
+    uint64_t getMicros() override { return m_now; }
+
+    void advance(uint32_t ms) { m_now += static_cast<uint64_t>( ms ) * 1000; }
+
+private:
+    TimeoutState m_state1{};
+    GenericState<sme::NO_ENTER, sme::NO_UPDATE, sme::NO_EXIT, state2Table> m_state2{STATE_2};
+    GenericState<sme::NO_ENTER, sme::NO_UPDATE, sme::NO_EXIT, sme::NO_TABLE> m_state3{STATE_3};
+    uint64_t m_now = 0;
+};
+
+TEST(ST, checkCancelTimersOnExit)
+{
+    TimeoutFsm sm;
+
+    sm.setCancelTimersOnExit( true );
+    sm.begin(STATE_1);
+    sm.sendEvent( { EVENT_1, 0 } );
+    sm.update();
+    CHECK_EQUAL( STATE_2, sm.getActiveId() );
+    // Timer of STATE_1 must not switch state machine to STATE_3
+    sm.advance( 100 );
+    sm.update();
+    CHECK_EQUAL( STATE_2, sm.getActiveId() );
+    sm.end();
+
+    TimeoutFsm sm2;
+    sm2.begin(STATE_1);
+    sm2.sendEvent( { EVENT_1, 0 } );
+    sm2.update();
+    CHECK_EQUAL( STATE_2, sm2.getActiveId() );
+    sm2.advance( 100 );
+    sm2.update();
+    CHECK_EQUAL( STATE_3, sm2.getActiveId() );
+    sm2.end();
+}
+
+TEST(ST, checkHibernatedTimerHandles)
+{
+    TimeoutFsm sm;
+    sm.begin(STATE_2);
+    SmTimerHandle old = sm.sendEvent( { EVENT_3, 0 }, 50 );
+    SmEngineSnapshot snapshot;
+    sm.hibernate( snapshot );
+    CHECK_FALSE( sm.cancel( old ) );
+
+    TimeoutFsm sm2;
+    CHECK_TRUE( sm2.begin() );
+    CHECK_TRUE( sm2.resume( snapshot ) );
+    // Handles, issued before hibernation, must not cancel new timers
+    SmTimerHandle timer = sm2.sendEvent( { EVENT_1, 0 }, 10 );
+    CHECK_TRUE( timer != old );
+    CHECK_FALSE( sm2.cancel( old ) );
+    sm2.advance( 10 );
+    sm2.update();
+    CHECK_EQUAL( STATE_2, sm2.getActiveId() );
+    sm2.advance( 40 );
+    sm2.update();
+    CHECK_EQUAL( STATE_3, sm2.getActiveId() );
+    sm2.end();
+}
+
+static C_TRANSITION_TBL(stateTimeoutTable)
+{
+    TRANSITION_SWITCH(SM_EVENT_TIMEOUT, SM_EVENT_ARG_ANY, sme::NO_FUNC, STATE_2)
+    TRANSITION_TBL_END
+}
+
+static C_TRANSITION_TBL(stateBackTable)
+{
+    TRANSITION_SWITCH(EVENT_1, SM_EVENT_ARG_ANY, sme::NO_FUNC, STATE_1)
+    TRANSITION_TBL_END
+}
+
+TEST(ST, checkStateTimeout)
+{
+    GenericState<sme::NO_ENTER, sme::NO_UPDATE, sme::NO_EXIT, stateTimeoutTable> state1(STATE_1);
+    GenericState<sme::NO_ENTER, sme::NO_UPDATE, sme::NO_EXIT, stateBackTable> state2(STATE_2);
+    SmStateInfo statesList[] =
+    {
+        STATE_LIST_ITEM(state1),
+        STATE_LIST_ITEM(state2),
+        STATE_LIST_END,
+    };
+    FakeClockEngine sm(statesList);
+
+    state1.setTimeout( 100 );
+    sm.begin(STATE_1);
+    sm.advance( 99 );
+    sm.update();
+    CHECK_EQUAL( STATE_1, sm.getActiveId() );
+    sm.advance( 1 );
+    sm.update();
+    CHECK_EQUAL( STATE_2, sm.getActiveId() );
+    // Timeout is rearmed on each enter, and the old one must not fire
+    sm.advance( 50 );
+    sm.sendEvent( { EVENT_1, 0 } );
+    sm.update();
+    CHECK_EQUAL( STATE_1, sm.getActiveId() );
+    sm.advance( 99 );
+    sm.update();
+    CHECK_EQUAL( STATE_1, sm.getActiveId() );
+    sm.advance( 1 );
+    sm.update();
+    CHECK_EQUAL( STATE_2, sm.getActiveId() );
+    sm.end();
+}
+
+class PollTimeoutState: public SmState
+{
+public:
+    PollTimeoutState(): SmState("poll") {}
+
+    void update() override
+    {
+        timeoutEvent( 1500, true );
+    }
+
+    STransitionData onEvent(SEventData event) override
+    {
+        TRANSITION_SWITCH(SM_EVENT_TIMEOUT, 1500, sme::NO_FUNC, STATE_2)
+        TRANSITION_TBL_END
+    }
+};
+
+TEST(ST, checkTimeoutEventMicros)
+{
+    PollTimeoutState state1;
+    state1.setId( STATE_1 );
+    GenericState<sme::NO_ENTER, sme::NO_UPDATE, sme::NO_EXIT, sme::NO_TABLE> state2(STATE_2);
+    SmStateInfo statesList[] =
+    {
+        STATE_LIST_ITEM(state1),
+        STATE_LIST_ITEM(state2),
+        STATE_LIST_END,
+    };
+    FakeClockEngine sm(statesList);
+
+    sm.begin(STATE_1);
+    uint64_t start = sm.getMicros();
+    sm.update();
+    // timeoutEvent() takes microseconds, and the tickless deadline is exact
+    CHECK_EQUAL( start + 1500, sm.getNextDeadline() );
+    sm.advanceMicros( 1499 );
+    sm.update();
+    sm.update();
+    CHECK_EQUAL( STATE_1, sm.getActiveId() );
+    sm.advanceMicros( 1 );
+    sm.update();
+    sm.update();
+    CHECK_EQUAL( STATE_2, sm.getActiveId() );
+    sm.end();
+}
+
+#if SM_ENGINE_USE_STL
+TEST(ST, checkMicrosClock)
+{
+    GenericState<sme::NO_ENTER, sme::NO_UPDATE, sme::NO_EXIT, sme::NO_TABLE> state1(STATE_1);
+    SmStateInfo statesList[] =
+    {
+        STATE_LIST_ITEM(state1),
+        STATE_LIST_END,
+    };
+    GenericStateEngine<sme::NO_TABLE> sm(statesList);
+    uint64_t start = sm.getMicros();
+    std::this_thread::sleep_for( std::chrono::milliseconds( 2 ) );
+    uint64_t elapsed = sm.getMicros() - start;
+    // Default clock counts microseconds, not milliseconds
+    CHECK_TRUE( elapsed >= 2000 );
+    CHECK_TRUE( elapsed < 2000000 );
+}
+#endif
+
+TEST(ST, checkPeriodicEvents)
+{
+    GenericState<sme::NO_ENTER, sme::NO_UPDATE, sme::NO_EXIT, countTable> state1(STATE_1);
+    SmStateInfo statesList[] =
+    {
+        STATE_LIST_ITEM(state1),
+        STATE_LIST_END,
+    };
+    FakeClockEngine sm(statesList);
+
+    sm.begin(STATE_1);
+    s_received = 0;
+    SmTimerHandle handle = sm.sendPeriodicEvent( { EVENT_1, 0 }, 10, ETimerPolicy::CATCH_UP );
+    sm.advance( 10 );
+    sm.update();
+    CHECK_EQUAL( 1, s_received );
+    sm.advance( 35 );
+    sm.update();
+    CHECK_EQUAL( 4, s_received );
+    // Cadence is not shifted by late processing
+    sm.advance( 5 );
+    sm.update();
+    CHECK_EQUAL( 5, s_received );
+    CHECK_TRUE( sm.cancel( handle ) );
+
+    s_received = 0;
+    handle = sm.sendPeriodicEvent( { EVENT_1, 0 }, 10, ETimerPolicy::COALESCE );
+    sm.advance( 35 );
+    sm.update();
+    CHECK_EQUAL( 1, s_received );
+    sm.advance( 5 );
+    sm.update();
+    CHECK_EQUAL( 2, s_received );
+    CHECK_TRUE( sm.cancel( handle ) );
+
+    s_received = 0;
+    handle = sm.sendPeriodicEvent( { EVENT_1, 0 }, 10, ETimerPolicy::SKIP );
+    sm.advance( 35 );
+    sm.update();
+    CHECK_EQUAL( 0, s_received );
+    sm.advance( 5 );
+    sm.update();
+    CHECK_EQUAL( 1, s_received );
+    CHECK_TRUE( sm.cancel( handle ) );
+    sm.advance( 100 );
+    sm.update();
+    CHECK_EQUAL( 1, s_received );
+    sm.end();
+}
+
+TEST(ST, checkMaxBatchSize)
+{
+    GenericState<sme::NO_ENTER, sme::NO_UPDATE, sme::NO_EXIT, countTable> state1(STATE_1);
+    SmStateInfo statesList[] =
+    {
+        STATE_LIST_ITEM(state1),
+        STATE_LIST_END,
+    };
+    GenericStateEngine<sme::NO_TABLE> sm(statesList);
+
+    s_received = 0;
+    sm.begin(STATE_1);
+    sm.setMaxBatchSize( 3 );
+    for (int i = 0; i < 8; i++)
+    {
+        sm.sendEvent( { EVENT_1, 0 } );
+    }
+    sm.update();
+    CHECK_EQUAL( 3, s_received );
+    sm.update();
+    CHECK_EQUAL( 6, s_received );
+    sm.setMaxBatchSize( 0 );
+    sm.update();
+    CHECK_EQUAL( 8, s_received );
+    sm.end();
+}
+
+TEST(ST, checkSendEvents)
+{
+    GenericState<sme::NO_ENTER, sme::NO_UPDATE, sme::NO_EXIT, countTable> state1(STATE_1);
+    SmStateInfo statesList[] =
+    {
+        STATE_LIST_ITEM(state1),
+        STATE_LIST_END,
+    };
+    GenericStateEngine<sme::NO_TABLE> sm(statesList, 8);
+
+    s_received = 0;
+    sm.begin(STATE_1);
+    SEventData events[10];
+    for (auto &event: events)
+    {
+        event = { EVENT_1, 0 };
+    }
+    CHECK_EQUAL( 8, sm.sendEvents( events, 10 ) );
+    sm.update();
+    CHECK_EQUAL( 8, s_received );
+
+    SmEventBuffer<4> buffer( sm );
+    for (int i = 0; i < 6; i++)
+    {
+        CHECK_TRUE( buffer.sendEvent( { EVENT_1, 0 } ) );
+    }
+    CHECK_EQUAL( 2, buffer.size() );
+    sm.update();
+    CHECK_EQUAL( 12, s_received );
+    CHECK_EQUAL( 2, buffer.flush() );
+    sm.update();
+    CHECK_EQUAL( 14, s_received );
+    sm.end();
+}
+
+TEST(ST, checkEventBufferTimeout)
+{
+    GenericState<sme::NO_ENTER, sme::NO_UPDATE, sme::NO_EXIT, countTable> state1(STATE_1);
+    SmStateInfo statesList[] =
+    {
+        STATE_LIST_ITEM(state1),
+        STATE_LIST_END,
+    };
+    FakeClockEngine sm(statesList);
+
+    s_received = 0;
+    sm.begin(STATE_1);
+    SmEventBuffer<4> buffer( sm, 10 );
+    CHECK_EQUAL( UINT64_MAX, buffer.getFlushDeadline() );
+    CHECK_TRUE( buffer.sendEvent( { EVENT_1, 0 } ) );
+    CHECK_EQUAL( sm.getMicros() + 10000, buffer.getFlushDeadline() );
+    sm.advance( 9 );
+    CHECK_EQUAL( 0, buffer.flushIfDue() );
+    CHECK_EQUAL( 1, buffer.size() );
+    // The producer has no new events, and the owner loop flushes the buffer
+    sm.advance( 1 );
+    CHECK_EQUAL( 1, buffer.flushIfDue() );
+    CHECK_EQUAL( 0, buffer.size() );
+    CHECK_EQUAL( UINT64_MAX, buffer.getFlushDeadline() );
+    sm.update();
+    CHECK_EQUAL( 1, s_received );
+    sm.end();
+}
+
+static uint8_t s_order[32];
+static int s_orderCount = 0;
+
+static void recordEvent(uint8_t id)
+{
+    s_order[s_orderCount++ % 32] = id;
+}
+
+static C_TRANSITION_TBL(recordTable)
+{
+    if ( event.event != SM_EVENT_TIMEOUT )
+    {
+        recordEvent( event.event );
+        return { EEventResult::PROCESSED_AND_HOOKED, SM_STATE_NONE };
+    }
+    TRANSITION_TBL_END
+}
+
+TEST(ST, checkPriorityLanes)
+{
+    GenericState<sme::NO_ENTER, sme::NO_UPDATE, sme::NO_EXIT, recordTable> state1(STATE_1);
+    SmStateInfo statesList[] =
+    {
+        STATE_LIST_ITEM(state1),
+        STATE_LIST_END,
+    };
+    GenericStateEngine<sme::NO_TABLE> sm(statesList);
+
+    sm.setEventPriority( EVENT_3, 0 );
+    sm.setEventPriority( EVENT_1, 2 );
+    sm.setLaneCapacity( 0, 4 );
+    sm.setLaneCapacity( 2, 4 );
+    sm.begin(STATE_1);
+    for (int i = 0; i < 5; i++)
+    {
+        sm.sendEvent( { EVENT_1, 0 } );
+    }
+    CHECK_EQUAL( 1, sm.getDroppedEvents( 2 ) );
+    sm.sendEvent( { EVENT_2, 0 } );
+    sm.sendEvent( { EVENT_3, 0 } );
+    s_orderCount = 0;
+    sm.update();
+    CHECK_EQUAL( 6, s_orderCount );
+    CHECK_EQUAL( EVENT_3, s_order[0] );
+    CHECK_EQUAL( EVENT_2, s_order[1] );
+    CHECK_EQUAL( EVENT_1, s_order[2] );
+
+    sm.setLaneDrainPolicy( ELaneDrainPolicy::WEIGHTED );
+    sm.setLaneWeight( 1, 2 );
+    for (int i = 0; i < 3; i++)
+    {
+        sm.sendEvent( { EVENT_1, 0 } );
+        sm.sendEvent( { EVENT_2, 0 } );
+    }
+    s_orderCount = 0;
+    sm.update();
+    CHECK_EQUAL( 6, s_orderCount );
+    CHECK_EQUAL( EVENT_2, s_order[0] );
+    CHECK_EQUAL( EVENT_2, s_order[1] );
+    CHECK_EQUAL( EVENT_1, s_order[2] );
+    CHECK_EQUAL( EVENT_2, s_order[3] );
+    CHECK_EQUAL( EVENT_1, s_order[4] );
+    sm.end();
+}
+
+TEST(ST, checkDisabledLanes)
+{
+    GenericState<sme::NO_ENTER, sme::NO_UPDATE, sme::NO_EXIT, recordTable> state1(STATE_1);
+    SmStateInfo statesList[] =
+    {
+        STATE_LIST_ITEM(state1),
+        STATE_LIST_END,
+    };
+    GenericStateEngine<sme::NO_TABLE> sm(statesList, 2);
+
+    // Lanes without own capacity share the capacity of the default lane
+    sm.setEventPriority( EVENT_3, 0 );
+    sm.begin(STATE_1);
+    CHECK_TRUE( sm.sendEvent( { EVENT_3, 0 } ) );
+    CHECK_TRUE( sm.sendPriorityEvent( { EVENT_1, 0 }, 2 ) );
+    CHECK_FALSE( sm.sendEvent( { EVENT_2, 0 } ) );
+    CHECK_EQUAL( 1, sm.getDroppedEvents( SM_LANE_DEFAULT ) );
+    s_orderCount = 0;
+    sm.update();
+    CHECK_EQUAL( 2, s_orderCount );
+    CHECK_EQUAL( EVENT_3, s_order[0] );
+    CHECK_EQUAL( EVENT_1, s_order[1] );
+    sm.end();
+}
+
+static uintptr_t s_lastArg = 0;
+
+static C_TRANSITION_TBL(argTable)
+{
+    NO_TRANSITION(EVENT_1, SM_EVENT_ARG_ANY, ( s_received++, s_lastArg = event.arg ))
+    NO_TRANSITION(EVENT_2, SM_EVENT_ARG_ANY, s_received++)
+    TRANSITION_TBL_END
+}
+
+TEST(ST, checkEventCoalescing)
+{
+    GenericState<sme::NO_ENTER, sme::NO_UPDATE, sme::NO_EXIT, argTable> state1(STATE_1);
+    SmStateInfo statesList[] =
+    {
+        STATE_LIST_ITEM(state1),
+        STATE_LIST_END,
+    };
+    GenericStateEngine<sme::NO_TABLE> sm(statesList, 4);
+
+    CHECK_TRUE( sm.setEventCoalescing( EVENT_1, true ) );
+    sm.begin(STATE_1);
+    s_received = 0;
+    for (uintptr_t i = 1; i <= 100; i++)
+    {
+        CHECK_TRUE( sm.sendEvent( { EVENT_1, i } ) );
+    }
+    CHECK_TRUE( sm.sendEvent( { EVENT_2, 0 } ) );
+    sm.update();
+    CHECK_EQUAL( 2, s_received );
+    CHECK_EQUAL( 100, s_lastArg );
+    CHECK_TRUE( sm.sendEvent( { EVENT_1, 200 } ) );
+    sm.update();
+    CHECK_EQUAL( 3, s_received );
+    CHECK_EQUAL( 200, s_lastArg );
+    sm.end();
+}
+
+#if SM_ENGINE_MULTITHREAD
+TEST(ST, checkCoalescingFullLane)
+{
+    GenericState<sme::NO_ENTER, sme::NO_UPDATE, sme::NO_EXIT, argTable> state1(STATE_1);
+    SmStateInfo statesList[] =
+    {
+        STATE_LIST_ITEM(state1),
+        STATE_LIST_END,
+    };
+    GenericStateEngine<sme::NO_TABLE> sm(statesList, 1);
+
+    CHECK_TRUE( sm.setEventCoalescing( EVENT_1, true ) );
+    sm.begin(STATE_1);
+    s_received = 0;
+    CHECK_TRUE( sm.sendEvent( { EVENT_2, 0 } ) );
+    // No sender may report the event accepted, while the lane is full
+    std::atomic<int> accepted{0};
+    std::vector<std::thread> producers;
+    for (int i = 0; i < 4; i++)
+    {
+        producers.emplace_back( [&sm, &accepted]()
+        {
+            for (uintptr_t n = 1; n <= 1000; n++)
+            {
+                if ( sm.sendEvent( { EVENT_1, n } ) )
+                {
+                    accepted++;
+                }
+            }
+        } );
+    }
+    for (auto &producer: producers)
+    {
+        producer.join();
+    }
+    CHECK_EQUAL( 0, accepted.load() );
+    sm.update();
+    CHECK_EQUAL( 1, s_received );
+    // The slot is not left pending after failed sends
+    CHECK_TRUE( sm.sendEvent( { EVENT_1, 7 } ) );
+    sm.update();
+    CHECK_EQUAL( 2, s_received );
+    CHECK_EQUAL( 7, s_lastArg );
+    sm.end();
+}
+#endif
+
+TEST(ST, checkEventFilters)
+{
+    GenericState<sme::NO_ENTER, sme::NO_UPDATE, sme::NO_EXIT, argTable> state1(STATE_1);
+    SmStateInfo statesList[] =
+    {
+        STATE_LIST_ITEM(state1),
+        STATE_LIST_END,
+    };
+    FakeClockEngine sm(statesList);
+
+    CHECK_TRUE( sm.setEventFilter( EVENT_1, EEventFilter::DEBOUNCE_TRAILING, 50 ) );
+    CHECK_TRUE( sm.setEventFilter( EVENT_2, EEventFilter::THROTTLE, 100 ) );
+    sm.begin(STATE_1);
+    s_received = 0;
+    for (uintptr_t i = 1; i <= 5; i++)
+    {
+        sm.sendEvent( { EVENT_1, i } );
+        sm.sendEvent( { EVENT_2, 0 } );
+        sm.update();
+        sm.advance( 20 );
+    }
+    // Only first EVENT_2 passed the throttle, EVENT_1 is still postponed
+    CHECK_EQUAL( 1, s_received );
+    sm.advance( 30 );
+    sm.update();
+    CHECK_EQUAL( 2, s_received );
+    CHECK_EQUAL( 5, s_lastArg );
+    sm.sendEvent( { EVENT_2, 0 } );
+    sm.update();
+    CHECK_EQUAL( 3, s_received );
+
+    CHECK_TRUE( sm.setEventFilter( EVENT_1, EEventFilter::DEBOUNCE_LEADING, 50 ) );
+    sm.sendEvent( { EVENT_1, 7 } );
+    sm.update();
+    sm.advance( 40 );
+    sm.sendEvent( { EVENT_1, 8 } );
+    sm.update();
+    sm.advance( 40 );
+    sm.sendEvent( { EVENT_1, 9 } );
+    sm.update();
+    CHECK_EQUAL( 4, s_received );
+    CHECK_EQUAL( 7, s_lastArg );
+    sm.advance( 50 );
+    sm.sendEvent( { EVENT_1, 10 } );
+    sm.update();
+    CHECK_EQUAL( 5, s_received );
+    CHECK_EQUAL( 10, s_lastArg );
+    sm.end();
+}
+
+TEST(ST, checkOverflowPolicies)
+{
+    GenericState<sme::NO_ENTER, sme::NO_UPDATE, sme::NO_EXIT, argTable> state1(STATE_1);
+    SmStateInfo statesList[] =
+    {
+        STATE_LIST_ITEM(state1),
+        STATE_LIST_END,
+    };
+    GenericStateEngine<sme::NO_TABLE> sm(statesList, 4);
+    sm.begin(STATE_1);
+    s_received = 0;
+
+    sm.setOverflowPolicy( EOverflowPolicy::DROP_OLDEST );
+    for (uintptr_t i = 1; i <= 6; i++)
+    {
+        CHECK_TRUE( sm.sendEvent( { EVENT_1, i } ) );
+    }
+    sm.update();
+    CHECK_EQUAL( 4, s_received );
+    CHECK_EQUAL( 6, s_lastArg );
+    CHECK_EQUAL( 2, sm.getQueueStats( SM_LANE_DEFAULT ).evicted );
+
+    sm.setOverflowPolicy( EOverflowPolicy::OVERWRITE_SAME_ID );
+    CHECK_TRUE( sm.sendEvent( { EVENT_1, 1 } ) );
+    for (int i = 0; i < 3; i++)
+    {
+        CHECK_TRUE( sm.sendEvent( { EVENT_2, 0 } ) );
+    }
+    CHECK_TRUE( sm.sendEvent( { EVENT_1, 9 } ) );
+    CHECK_FALSE( sm.sendEvent( { EVENT_3, 0 } ) );
+    sm.update();
+    CHECK_EQUAL( 8, s_received );
+    CHECK_EQUAL( 9, s_lastArg );
+    CHECK_EQUAL( 1, sm.getQueueStats( SM_LANE_DEFAULT ).overwritten );
+    CHECK_EQUAL( 1, sm.getQueueStats( SM_LANE_DEFAULT ).rejected );
+
+    sm.setLaneCapacity( SM_LANE_DEFAULT, 2, 8 );
+    sm.setOverflowPolicy( EOverflowPolicy::GROW );
+    for (int i = 0; i < 8; i++)
+    {
+        CHECK_TRUE( sm.sendEvent( { EVENT_2, 0 } ) );
+    }
+    CHECK_FALSE( sm.sendEvent( { EVENT_2, 0 } ) );
+    CHECK_EQUAL( 2, sm.getQueueStats( SM_LANE_DEFAULT ).grown );
+    sm.update();
+    CHECK_EQUAL( 16, s_received );
+    sm.end();
+}
+
+#if SM_ENGINE_MULTITHREAD
+TEST(ST, checkBlockingOverflow)
+{
+    GenericState<sme::NO_ENTER, sme::NO_UPDATE, sme::NO_EXIT, countTable> state1(STATE_1);
+    SmStateInfo statesList[] =
+    {
+        STATE_LIST_ITEM(state1),
+        STATE_LIST_END,
+    };
+    GenericStateEngine<sme::NO_TABLE> sm(statesList, 4);
+    sm.setOverflowPolicy( EOverflowPolicy::BLOCK, 2000 );
+    sm.begin(STATE_1);
+    s_received = 0;
+    sm.update();
+
+    for (int i = 0; i < 4; i++)
+    {
+        CHECK_TRUE( sm.sendEvent( { EVENT_1, 0 } ) );
+    }
+    // update() thread never blocks
+    CHECK_FALSE( sm.sendEvent( { EVENT_1, 0 } ) );
+    bool sent = false;
+    std::thread producer( [&sm, &sent]() { sent = sm.sendEvent( { EVENT_1, 0 } ); } );
+    while ( sm.getQueueStats( SM_LANE_DEFAULT ).blocked == 0 )
+    {
+        std::this_thread::yield();
+    }
+    sm.update();
+    producer.join();
+    CHECK_TRUE( sent );
+    sm.update();
+    CHECK_EQUAL( 5, s_received );
+    CHECK_EQUAL( 1, sm.getQueueStats( SM_LANE_DEFAULT ).rejected );
+    sm.end();
+}
+
+TEST(ST, checkQueueLimitUnderContention)
+{
+    // Producers push only while the queue is below the limit, so no push may fail
+    const int limit = 4;
+    const int perProducer = 100000;
+    sme::mpsc_queue<int> queue;
+    queue.reset( limit, 64 );
+    std::atomic<int> credits{limit};
+    std::atomic<int> rejected{0};
+    auto producer = [&]()
+    {
+        for (int i = 0; i < perProducer; i++)
+        {
+            int available = credits.load();
+            while ( available == 0 || !credits.compare_exchange_weak( available, available - 1 ) )
+            {
+                std::this_thread::yield();
+                available = credits.load();
+            }
+            if ( !queue.push( i ) )
+            {
+                rejected++;
+                credits++;
+            }
+        }
+    };
+    std::thread first( producer );
+    std::thread second( producer );
+    int popped = 0;
+    while ( popped + rejected.load() < 2 * perProducer )
+    {
+        int value;
+        if ( queue.pop( value ) )
+        {
+            popped++;
+            credits++;
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+    first.join();
+    second.join();
+    CHECK_EQUAL( 0, rejected.load() );
+    CHECK_EQUAL( 2 * perProducer, popped );
+}
+#endif
+
+#if SM_ENGINE_USE_STL
+TEST(ST, checkTicklessLoop)
+{
+    GenericState<sme::NO_ENTER, sme::NO_UPDATE, sme::NO_EXIT, countTable> state1(STATE_1);
+    SmStateInfo statesList[] =
+    {
+        STATE_LIST_ITEM(state1),
+        STATE_LIST_END,
+    };
+    GenericStateEngine<sme::NO_TABLE> sm(statesList);
+    sm.begin(STATE_1);
+    s_received = 0;
+
+    std::thread engine( [&sm]() { sm.loop(); } );
+    std::this_thread::sleep_for( std::chrono::milliseconds( 20 ) );
+    // The engine sleeps without deadline, new timer must wake it up
+    sm.sendEvent( { EVENT_1, 0 }, 30 );
+    std::this_thread::sleep_for( std::chrono::milliseconds( 200 ) );
+    // stop() wakes up the engine too
+    sm.stop();
+    engine.join();
+    CHECK_EQUAL( 1, s_received );
+    sm.end();
+}
+#endif
+
+#if SM_ENGINE_USE_STL
+TEST(ST, checkWaitStrategies)
+{
+    GenericState<sme::NO_ENTER, sme::NO_UPDATE, sme::NO_EXIT, countTable> state1(STATE_1);
+    SmStateInfo statesList[] =
+    {
+        STATE_LIST_ITEM(state1),
+        STATE_LIST_END,
+    };
+    const EWaitStrategy strategies[] = { EWaitStrategy::SPIN_YIELD, EWaitStrategy::SPIN_PARK };
+    for (auto strategy: strategies)
+    {
+        GenericStateEngine<sme::NO_TABLE> sm(statesList);
+        sm.setWaitStrategy( strategy, 256 );
+        sm.begin(STATE_1);
+        s_received = 0;
+
+        std::thread engine( [&sm]() { sm.loop(); } );
+        sm.sendEvent( { EVENT_1, 0 } );
+        sm.sendEvent( { EVENT_1, 0 }, 10 );
+        std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) );
+        sm.stop();
+        engine.join();
+        CHECK_EQUAL( 2, s_received );
+        sm.end();
+    }
+}
+#endif
+
+#if SM_ENGINE_POLL_FD && SM_ENGINE_USE_STL
+TEST(ST, checkPollFds)
+{
+    GenericState<sme::NO_ENTER, sme::NO_UPDATE, sme::NO_EXIT, countTable> state1(STATE_1);
+    SmStateInfo statesList[] =
+    {
+        STATE_LIST_ITEM(state1),
+        STATE_LIST_END,
+    };
+    GenericStateEngine<sme::NO_TABLE> sm(statesList);
+    CHECK_TRUE( sm.enablePollFds() );
+    sm.begin(STATE_1);
+    s_received = 0;
+
+    struct pollfd fds[2] = { { sm.getEventFd(), POLLIN, 0 }, { sm.getTimerFd(), POLLIN, 0 } };
+    CHECK_EQUAL( 0, poll( fds, 2, 0 ) );
+    std::thread producer( [&sm]() { sm.sendEvent( { EVENT_1, 0 } ); } );
+    CHECK_EQUAL( 1, poll( fds, 2, 1000 ) );
+    producer.join();
+    sm.processReady();
+    CHECK_EQUAL( 1, s_received );
+    CHECK_EQUAL( 0, poll( fds, 2, 0 ) );
+
+    // timerfd is armed for the deferred event
+    sm.sendEvent( { EVENT_1, 0 }, 20 );
+    sm.processReady();
+    CHECK_EQUAL( 1, s_received );
+    CHECK_EQUAL( 1, poll( fds, 2, 1000 ) );
+    CHECK_TRUE( fds[1].revents & POLLIN );
+    sm.processReady();
+    CHECK_EQUAL( 2, s_received );
+    CHECK_EQUAL( 0, poll( fds, 2, 50 ) );
+    sm.end();
+}
+#endif
+
+#if SM_ENGINE_MULTITHREAD && SM_ENGINE_USE_STL
+static std::atomic<int> s_executed{0};
+
+static C_TRANSITION_TBL(executorTable)
+{
+    NO_TRANSITION(EVENT_1, SM_EVENT_ARG_ANY, s_executed++)
+    TRANSITION_TBL_END
+}
+
+TEST(ST, checkExecutor)
+{
+    GenericState<sme::NO_ENTER, sme::NO_UPDATE, sme::NO_EXIT, executorTable> state1(STATE_1);
+    SmStateInfo statesList[] =
+    {
+        STATE_LIST_ITEM(state1),
+        STATE_LIST_END,
+    };
+    const int engines = 8;
+    std::vector<std::unique_ptr<GenericStateEngine<sme::NO_TABLE>>> sm;
+    SmExecutor executor( 2 );
+    s_executed = 0;
+    for (int i = 0; i < engines; i++)
+    {
+        sm.emplace_back( new GenericStateEngine<sme::NO_TABLE>( statesList, 64 ) );
+        sm[i]->begin( STATE_1 );
+        executor.add( *sm[i] );
+    }
+    executor.start();
+    for (int n = 0; n < 50; n++)
+    {
+        for (int i = 0; i < engines; i++)
+        {
+            CHECK_TRUE( sm[i]->sendEvent( { EVENT_1, 0 } ) );
+        }
+    }
+    // Deferred events wake up idle engines too
+    for (int i = 0; i < engines; i++)
+    {
+        sm[i]->sendEvent( { EVENT_1, 0 }, 20 );
+    }
+    for (int i = 0; i < 200 && s_executed < engines * 51; i++)
+    {
+        std::this_thread::sleep_for( std::chrono::milliseconds( 5 ) );
+    }
+    executor.stop();
+    CHECK_EQUAL( engines * 51, s_executed.load() );
+    for (auto &engine: sm)
+    {
+        engine->end();
+    }
+}
+
+static std::atomic<bool> s_flooding{false};
+
+class FloodState: public SmState
+{
+public:
+    FloodState(): SmState("flood") { }
+
+    STransitionData onEvent(SEventData event) override
+    {
+        // The engine never becomes idle, while flooding is on
+        if ( s_flooding )
+        {
+            sendEvent( { EVENT_1, 0 } );
+        }
+        return { EEventResult::PROCESSED_AND_HOOKED, SM_STATE_NONE };
+    }
+};
+
+TEST(ST, checkExecutorTimersUnderLoad)
+{
+    FloodState flood;
+    flood.setId( STATE_1 );
+    SmStateInfo floodList[] =
+    {
+        STATE_LIST_ITEM(flood),
+        STATE_LIST_END,
+    };
+    GenericState<sme::NO_ENTER, sme::NO_UPDATE, sme::NO_EXIT, executorTable> state1(STATE_1);
+    SmStateInfo statesList[] =
+    {
+        STATE_LIST_ITEM(state1),
+        STATE_LIST_END,
+    };
+    GenericStateEngine<sme::NO_TABLE> busy( floodList, 64 );
+    GenericStateEngine<sme::NO_TABLE> waiting( statesList, 64 );
+    SmExecutor executor( 1 );
+    s_executed = 0;
+    s_flooding = true;
+    busy.begin( STATE_1 );
+    waiting.begin( STATE_1 );
+    executor.add( busy );
+    executor.add( waiting );
+    executor.start();
+    CHECK_TRUE( busy.sendEvent( { EVENT_1, 0 } ) );
+    waiting.sendEvent( { EVENT_1, 0 }, 20 );
+    for (int i = 0; i < 200 && s_executed == 0; i++)
+    {
+        std::this_thread::sleep_for( std::chrono::milliseconds( 5 ) );
+    }
+    s_flooding = false;
+    executor.stop();
+    CHECK_EQUAL( 1, s_executed.load() );
+    busy.end();
+    waiting.end();
+}
+#endif
+
+#if SM_ENGINE_USE_STL
+static uint64_t s_now = 0;
+
+class KeyedFsm: public SmEngine
+{
+public:
+    KeyedFsm(): SmEngine()
+    {
+        SM_STATE( TimeoutState, STATE_1 );
+        addState( m_state2 );
+        addState( m_state3 );
+    }
+
+    uint64_t getMicros() override { return s_now; }
+
+private:
+    GenericState<sme::NO_ENTER, sme::NO_UPDATE, sme::NO_EXIT, state2Table> m_state2{STATE_2};
+    GenericState<sme::NO_ENTER, sme::NO_UPDATE, sme::NO_EXIT, sme::NO_TABLE> m_state3{STATE_3};
+};
+
+class FakeClockRegistry: public SmEngineRegistry<int>
+{
+public:
+    FakeClockRegistry(): SmEngineRegistry<int>( [](const int &key) -> ISmEngine * { return new KeyedFsm(); }, STATE_1 ) { }
+
+    uint64_t getMicros() override { return s_now; }
+};
+
+TEST(ST, checkEngineRegistry)
+{
+    FakeClockRegistry registry;
+    s_now = 0x100000000ULL;
+
+    CHECK_TRUE( registry.sendEvent( 7, { EVENT_2, 0 } ) );
+    CHECK_TRUE( registry.sendEvent( 8, { EVENT_2, 0 } ) );
+    CHECK_EQUAL( 2, registry.getResidentCount() );
+    CHECK_EQUAL( 2, registry.processReady() );
+    s_now += 50000;
+    CHECK_EQUAL( 2, registry.hibernate( 10 ) );
+    CHECK_EQUAL( 0, registry.getResidentCount() );
+    CHECK_EQUAL( 2, registry.getHibernatedCount() );
+
+    // Key 8 is resumed on demand, state is restored without enter()
+    CHECK_EQUAL( STATE_1, registry.get( 8 )->getActiveId() );
+    CHECK_TRUE( registry.sendEvent( 8, { EVENT_1, 0 } ) );
+    CHECK_EQUAL( 1, registry.processReady() );
+    CHECK_EQUAL( STATE_2, registry.get( 8 )->getActiveId() );
+
+    // Key 7 is resumed, when its timer is due
+    s_now += 49000;
+    registry.processReady();
+    CHECK_EQUAL( 1, registry.getResidentCount() );
+    s_now += 1000;
+    // Timer of key 8 is due too
+    CHECK_EQUAL( 2, registry.processReady() );
+    CHECK_EQUAL( 2, registry.getResidentCount() );
+    CHECK_EQUAL( STATE_3, registry.get( 7 )->getActiveId() );
+}
+
+TEST(ST, checkRegistryReadyList)
+{
+    FakeClockRegistry registry;
+    s_now = 0x100000000ULL;
+
+    for (int key = 0; key < 100; key++)
+    {
+        CHECK_TRUE( registry.get( key ) != nullptr );
+    }
+    // enter() of the initial state starts the timer, idle engines are not visited after that
+    CHECK_EQUAL( 100, registry.processReady() );
+    CHECK_EQUAL( 0, registry.processReady() );
+
+    // Events, sent directly to the engine, are reported by the notifier
+    CHECK_TRUE( registry.get( 5 )->sendEvent( { EVENT_1, 0 } ) );
+    CHECK_EQUAL( 1, registry.processReady() );
+    CHECK_EQUAL( STATE_2, registry.get( 5 )->getActiveId() );
+    CHECK_EQUAL( 0, registry.processReady() );
+
+    s_now += 100000;
+    CHECK_EQUAL( 100, registry.processReady() );
+    CHECK_EQUAL( STATE_3, registry.get( 42 )->getActiveId() );
+    CHECK_EQUAL( 0, registry.processReady() );
+}
+
+TEST(ST, checkRegistryStaleWakeups)
+{
+    FakeClockRegistry registry;
+    s_now = 0x100000000ULL;
+
+    CHECK_TRUE( registry.get( 9 ) != nullptr );
+    CHECK_EQUAL( 1, registry.processReady() );
+    SmTimerHandle timer = registry.get( 9 )->sendEvent( { EVENT_3, 0 }, 50 );
+    CHECK_EQUAL( 1, registry.processReady() );
+    // The wakeup entry of the cancelled timer stays in the registry
+    CHECK_TRUE( registry.get( 9 )->cancel( timer ) );
+    CHECK_EQUAL( 1, registry.hibernate( 0 ) );
+
+    s_now += 50000;
+    CHECK_EQUAL( 0, registry.processReady() );
+    CHECK_EQUAL( 0, registry.getResidentCount() );
+    // Timer of STATE_1 resumes the engine
+    s_now += 50000;
+    CHECK_EQUAL( 1, registry.processReady() );
+    CHECK_EQUAL( STATE_3, registry.get( 9 )->getActiveId() );
+}
+#endif
+
+class CounterState: public SmState
+{
+public:
+    CounterState(): SmState("counter") { setShared( true ); }
+
+    bool begin() override { begins++; return true; }
+
+    void end() override { ends++; }
+
+    STransitionData onEvent(SEventData event) override
+    {
+        (*getContext<int>())++;
+        // The event goes back to the engine, which runs the state now
+        if ( event.event == EVENT_1 )
+        {
+            sendEvent( { EVENT_2, 0 } );
+        }
+        return { EEventResult::PROCESSED_AND_HOOKED, SM_STATE_NONE };
+    }
+
+    int begins = 0;
+    int ends = 0;
+};
+
+TEST(ST, checkSharedStates)
+{
+    static CounterState counter;
+    static SmStateInfo statesList[] =
+    {
+        STATE_LIST_ITEM(counter),
+        STATE_LIST_END,
+    };
+    counter.setId( STATE_1 );
+    int context1 = 0;
+    int context2 = 0;
+    GenericStateEngine<sme::NO_TABLE> sm1(statesList);
+    GenericStateEngine<sme::NO_TABLE> sm2(statesList);
+    sm1.setContext( &context1 );
+    sm2.setContext( &context2 );
+    sm1.begin(STATE_1);
+    sm2.begin(STATE_1);
+    // Shared state is started once for all engines
+    CHECK_EQUAL( 1, counter.begins );
+
+    sm1.sendEvent( { EVENT_1, 0 } );
+    sm2.sendEvent( { EVENT_3, 0 } );
+    sm1.update();
+    sm2.update();
+    CHECK_EQUAL( 1, context1 );
+    CHECK_EQUAL( 1, context2 );
+    sm2.update();
+    sm1.update();
+    CHECK_EQUAL( 2, context1 );
+    CHECK_EQUAL( 1, context2 );
+    sm1.end();
+    CHECK_EQUAL( 0, counter.ends );
+    // Hibernation releases the state as end() does
+    SmEngineSnapshot snapshot;
+    sm2.hibernate( snapshot );
+    CHECK_EQUAL( 1, counter.ends );
+    CHECK_TRUE( sm2.begin() );
+    CHECK_TRUE( sm2.resume( snapshot ) );
+    CHECK_EQUAL( 2, counter.begins );
+    sm2.end();
+    CHECK_EQUAL( 2, counter.ends );
+}
+
+#if SM_ENGINE_USE_STL
+static int s_fleetActions = 0;
+
+static void fleetAction()
+{
+    s_fleetActions++;
+}
+
+static constexpr SmTransitionRow fleetRows[] =
+{
+    // Slow path: the transition depends on event argument
+    ROW_SWITCH(STATE_1, EVENT_1, 1, sme::NO_FUNC, STATE_2),
+    ROW_SIMPLE(STATE_2, EVENT_2, sme::NO_FUNC, STATE_1),
+    // Slow path: the transition has an action
+    ROW_SIMPLE(STATE_2, EVENT_3, fleetAction, STATE_3),
+    ROW_SIMPLE(STATE_3, EVENT_1, nullptr, STATE_1),
+    ROW_NO_TRANSITION(STATE_3, EVENT_2, SM_EVENT_ARG_ANY, sme::NO_FUNC),
+};
+
+TEST(ST, checkFleet)
+{
+    for (int vectorized = 0; vectorized < 2; vectorized++)
+    {
+        SmFleet<fleetRows> fleet( 20, 3 );
+        fleet.setVectorized( vectorized != 0 );
+        fleet.begin( STATE_1 );
+        s_fleetActions = 0;
+        for (int i = 0; i < fleet.size(); i += 2)
+        {
+            CHECK_EQUAL( true, fleet.sendEvent( i, { EVENT_1, 1 } ) );
+        }
+        CHECK_EQUAL( false, fleet.sendEvent( 0, { EVENT_1, 1 } ) );
+        CHECK_EQUAL( 10, fleet.step() );
+        CHECK_EQUAL( STATE_2, fleet.getState( 18 ) );
+        CHECK_EQUAL( STATE_1, fleet.getState( 19 ) );
+        for (int i = 0; i < fleet.size(); i++)
+        {
+            fleet.sendEvent( i, { EVENT_3, 1 } );
+        }
+        CHECK_EQUAL( 10, fleet.step() );
+        CHECK_EQUAL( 10, s_fleetActions );
+        CHECK_EQUAL( STATE_3, fleet.getState( 18 ) );
+        CHECK_EQUAL( STATE_1, fleet.getState( 19 ) );
+        // Dense table only: events without rows and rows without actions
+        for (int i = 0; i < fleet.size(); i++)
+        {
+            fleet.sendEvent( i, { EVENT_2, 5 } );
+        }
+        CHECK_EQUAL( 0, fleet.step() );
+        CHECK_EQUAL( STATE_3, fleet.getState( 18 ) );
+        CHECK_EQUAL( STATE_1, fleet.getState( 19 ) );
+        for (int i = 0; i < fleet.size(); i += 2)
+        {
+            fleet.sendEvent( i, { EVENT_1, 7 } );
+        }
+        CHECK_EQUAL( 0, fleet.step() );
+        CHECK_EQUAL( STATE_1, fleet.getState( 18 ) );
+        // The argument does not match, so the state is kept
+        fleet.sendEvent( 0, { EVENT_1, 2 } );
+        CHECK_EQUAL( 1, fleet.step() );
+        CHECK_EQUAL( STATE_1, fleet.getState( 0 ) );
+    }
+}
+
+TEST(ST, checkFleetNotStarted)
+{
+    SmFleet<fleetRows> fleet( 20, 3 );
+    // States are not set yet, and the dense table must not be read
+    CHECK_EQUAL( true, fleet.sendEvent( 0, { EVENT_1, 1 } ) );
+    CHECK_EQUAL( 0, fleet.step() );
+    CHECK_EQUAL( SM_STATE_NONE, fleet.getState( 0 ) );
+    CHECK_EQUAL( false, fleet.begin( 3 ) );
+    CHECK_EQUAL( 0, fleet.step() );
+    CHECK_EQUAL( true, fleet.begin( STATE_1 ) );
+    CHECK_EQUAL( true, fleet.sendEvent( 0, { EVENT_1, 1 } ) );
+    CHECK_EQUAL( 1, fleet.step() );
+    CHECK_EQUAL( STATE_2, fleet.getState( 0 ) );
+}
+#endif
+
+static int s_rowActions = 0;
+
+static void rowAction()
+{
+    s_rowActions++;
+}
+
+static constexpr SmTransitionRow masterRows[] =
+{
+    ROW_SWITCH(STATE_1, EVENT_1, 1, sme::NO_FUNC, STATE_2),
+    ROW_SWITCH(STATE_2, EVENT_2, 1, sme::NO_FUNC, STATE_1),
+    ROW_SWITCH(STATE_2, EVENT_3, 1, rowAction, STATE_3),
+    // The same as state1Table, but for any state
+    ROW_PUSH(SM_STATE_ANY, EVENT_2, 2, sme::NO_FUNC, STATE_2),
+    ROW_SWITCH(SM_STATE_ANY, EVENT_2, 0, sme::NO_FUNC, STATE_2),
+    ROW_SWITCH(SM_STATE_ANY, EVENT_3, 0, sme::NO_FUNC, STATE_3),
+    ROW_SIMPLE(SM_STATE_ANY, EVENT_3, nullptr, STATE_3),
+};
+
+TEST(ST, checkDenseTable)
+{
+    for (StateUid state = STATE_1; state <= STATE_3 + 1; state++)
+    {
+        for (uint8_t id = EVENT_1; id <= EVENT_3 + 1; id++)
+        {
+            for (uintptr_t arg = 0; arg < 4; arg++)
+            {
+                SEventData event = { id, arg };
+                STransitionData expected = masterTable( state, event );
+                if ( expected.result == EEventResult::NOT_PROCESSED )
+                {
+                    expected = state1Table( state, event );
+                }
+                STransitionData result = sme::denseTable<masterRows>( state, event );
+                CHECK( expected.result == result.result );
+                CHECK_EQUAL( expected.stateId, result.stateId );
+            }
+        }
+    }
+    CHECK_EQUAL( 1, s_rowActions );
+
+    GenericState<sme::NO_ENTER, sme::NO_UPDATE, sme::NO_EXIT, sme::NO_TABLE> state1(STATE_1);
+    GenericState<sme::NO_ENTER, sme::NO_UPDATE, sme::NO_EXIT, sme::denseTable<masterRows>> state2(STATE_2);
+    GenericState<sme::NO_ENTER, sme::NO_UPDATE, sme::NO_EXIT, sme::NO_TABLE> state3(STATE_3);
+    SmStateInfo statesList[] =
+    {
+        STATE_LIST_ITEM(state1),
+        STATE_LIST_ITEM(state2),
+        STATE_LIST_ITEM(state3),
+        STATE_LIST_END,
+    };
+    GenericStateEngine<sme::denseTable<masterRows>> sm(statesList);
+    sm.begin(STATE_1);
+    sm.sendEvent( { EVENT_1, 1 } );
+    sm.update();
+    CHECK_EQUAL( STATE_2, sm.getActiveId() );
+    sm.sendEvent( { EVENT_3, 1 } );
+    sm.update();
+    CHECK_EQUAL( STATE_3, sm.getActiveId() );
+    CHECK_EQUAL( 2, s_rowActions );
+    sm.end();
+}
+
+// Sparse opcodes: each row has its own event id and large argument
+#define OPCODE_ROW(n) ROW_SWITCH(SM_STATE_ANY, (n) * 37 % 251, (n) * 7919u, sme::NO_FUNC, (n) % 3),
+#define OPCODE_ROWS4(n) OPCODE_ROW(n) OPCODE_ROW(n + 1) OPCODE_ROW(n + 2) OPCODE_ROW(n + 3)
+#define OPCODE_ROWS16(n) OPCODE_ROWS4(n) OPCODE_ROWS4(n + 4) OPCODE_ROWS4(n + 8) OPCODE_ROWS4(n + 12)
+#define OPCODE_ROWS64(n) OPCODE_ROWS16(n) OPCODE_ROWS16(n + 16) OPCODE_ROWS16(n + 32) OPCODE_ROWS16(n + 48)
+
+static constexpr SmTransitionRow opcodeRows[] =
+{
+    OPCODE_ROWS64(0)
+    OPCODE_ROWS64(64)
+    OPCODE_ROWS64(128)
+    OPCODE_ROWS64(192)
+};
+
+TEST(ST, checkHashTable)
+{
+    for (StateUid state = STATE_1; state <= STATE_3 + 1; state++)
+    {
+        for (uint8_t id = EVENT_1; id <= EVENT_3 + 1; id++)
+        {
+            for (uintptr_t arg = 0; arg < 4; arg++)
+            {
+                SEventData event = { id, arg };
+                STransitionData expected = sme::denseTable<masterRows>( state, event );
+                STransitionData result = sme::hashTable<masterRows>( state, event );
+                CHECK( expected.result == result.result );
+                CHECK_EQUAL( expected.stateId, result.stateId );
+            }
+        }
+    }
+    for (int n = 0; n < 256; n++)
+    {
+        SEventData event = { static_cast<uint8_t>( n * 37 % 251 ), n * 7919u };
+        STransitionData result = sme::hashTable<opcodeRows>( STATE_2, event );
+        // Rows 251..255 repeat event ids of rows 0..4 with other arguments
+        CHECK( EEventResult::SWITCH_STATE == result.result );
+        CHECK_EQUAL( n % 3, result.stateId );
+        event.arg++;
+        CHECK( EEventResult::NOT_PROCESSED == sme::hashTable<opcodeRows>( STATE_2, event ).result );
+    }
+}
+
+// Arguments 4 and 148 have the same hash, so the first row is a false candidate
+static_assert( sme::argTag( 4 ) == sme::argTag( 148 ), "arguments must have the same hash" );
+static constexpr SmTransitionRow collisionRows[] =
+{
+    ROW_SWITCH(SM_STATE_ANY, EVENT_1, 4, sme::NO_FUNC, STATE_1),
+    ROW_SWITCH(SM_STATE_ANY, EVENT_1, 148, sme::NO_FUNC, STATE_2),
+};
+
+TEST(ST, checkScanTable)
+{
+    for (StateUid state = STATE_1; state <= STATE_3 + 1; state++)
+    {
+        for (uint8_t id = EVENT_1; id <= EVENT_3 + 1; id++)
+        {
+            for (uintptr_t arg = 0; arg < 4; arg++)
+            {
+                SEventData event = { id, arg };
+                STransitionData expected = sme::denseTable<masterRows>( state, event );
+                STransitionData result = sme::scanTable<masterRows>( state, event );
+                CHECK( expected.result == result.result );
+                CHECK_EQUAL( expected.stateId, result.stateId );
+            }
+        }
+    }
+    for (int n = 0; n < 256; n++)
+    {
+        SEventData event = { static_cast<uint8_t>( n * 37 % 251 ), n * 7919u };
+        CHECK_EQUAL( n % 3, sme::scanTable<opcodeRows>( STATE_2, event ).stateId );
+        event.arg++;
+        CHECK( EEventResult::NOT_PROCESSED == sme::scanTable<opcodeRows>( STATE_2, event ).result );
+    }
+    CHECK_EQUAL( STATE_2, sme::scanTable<collisionRows>( STATE_3, { EVENT_1, 148 } ).stateId );
+    CHECK_EQUAL( STATE_1, sme::scanTable<collisionRows>( STATE_3, { EVENT_1, 4 } ).stateId );
+    CHECK( EEventResult::NOT_PROCESSED == sme::scanTable<collisionRows>( STATE_3, { EVENT_1, 5 } ).result );
+}
+
+TEST(ST, checkStateIndex)
+{
+    GenericState<sme::NO_ENTER, sme::NO_UPDATE, sme::NO_EXIT, state1Table> state1(STATE_1);
+    GenericState<sme::NO_ENTER, sme::NO_UPDATE, sme::NO_EXIT, state2Table> state2(200);
+    GenericState<sme::NO_ENTER, sme::NO_UPDATE, sme::NO_EXIT, state3Table> state3(STATE_3);
+    SmEngine sm;
+    sm.addState( state1 );
+    sm.addState( state2 );
+    sm.begin( STATE_1 );
+    POINTERS_EQUAL( &state2, sm.getById( 200 ) );
+    POINTERS_EQUAL( nullptr, sm.getById( 199 ) );
+    POINTERS_EQUAL( nullptr, sm.getById( 250 ) );
+    // States, added after begin(), are found too
+    sm.addState( state3 );
+    POINTERS_EQUAL( &state3, sm.getById( STATE_3 ) );
+    sm.sendEvent( { EVENT_3, 0 } );
+    sm.update();
+    CHECK_EQUAL( STATE_3, sm.getActiveId() );
+    sm.end();
+}
+
+#if SM_ENGINE_USE_STL
+struct PlainState
+{
+    int entered = 0;
+    void enter(SEventData *event) { entered++; }
+    void update() { }
+    void exit(SEventData *event) { }
+    STransitionData onEvent(SEventData event) { return state3Table( STATE_3, event ); }
+};
+
+TEST(ST, checkStaticEngine)
+{
+    StaticEngine<masterTable,
+                 sme::StaticState<STATE_1, GenericState<sme::NO_ENTER, state1_do_work, sme::NO_EXIT, state1Table>>,
+                 sme::StaticState<STATE_2, GenericState<sme::NO_ENTER, sme::NO_UPDATE, sme::NO_EXIT, state2Table>>,
+                 sme::StaticState<STATE_3, PlainState>> sm;
+
+    // The same sequence as in checkPushPop
+    sm.begin(STATE_1);
+    sm.sendEvent( { EVENT_1, 2 } );
+    sm.update();
+    CHECK_EQUAL( STATE_1, sm.getActiveId() );
+    sm.sendEvent( { EVENT_2, 2 } );
+    sm.update();
+    CHECK_EQUAL( STATE_2, sm.getActiveId() );
+    sm.sendEvent( { EVENT_3, 2 } );
+    sm.update();
+    CHECK_EQUAL( STATE_3, sm.getActiveId() );
+    CHECK_EQUAL( 1, (sm.getState<sme::StaticState<STATE_3, PlainState>>().entered) );
+    sm.sendEvent( { EVENT_2, 2 } );
+    sm.update();
+    CHECK_EQUAL( STATE_2, sm.getActiveId() );
+    CHECK( EEventResult::POP_STATE == sm.processEvent( { EVENT_1, 2 } ) );
+    CHECK_EQUAL( STATE_1, sm.getActiveId() );
+    sm.end();
+    CHECK_EQUAL( SM_STATE_NONE, sm.getActiveId() );
+}
+
+class KickState: public SmState
+{
+public:
+    KickState(): SmState("kick") {}
+
+    void update() override
+    {
+        sendEvent( { EVENT_1, 0 } );
+    }
+
+    STransitionData onEvent(SEventData event) override
+    {
+        TRANSITION_SWITCH(EVENT_1, 0, sme::NO_FUNC, STATE_2)
+        TRANSITION_TBL_END
+    }
+};
+
+using KickEngine = StaticEngine<sme::NO_TABLE,
+                                sme::StaticState<STATE_1, KickState>,
+                                sme::StaticState<STATE_2, GenericState<sme::NO_ENTER, sme::NO_UPDATE, sme::NO_EXIT, sme::NO_TABLE>>>;
+
+static KickEngine *s_kickEngine = nullptr;
+
+static void updateKickEngine()
+{
+    s_kickEngine->update();
+}
+
+TEST(ST, checkStaticEngineSendEvent)
+{
+    KickEngine sm;
+    s_kickEngine = &sm;
+    GenericState<sme::NO_ENTER, updateKickEngine, sme::NO_EXIT, sme::NO_TABLE> state1(STATE_1);
+    SmStateInfo statesList[] =
+    {
+        STATE_LIST_ITEM(state1),
+        STATE_LIST_END,
+    };
+    GenericStateEngine<sme::NO_TABLE> outer(statesList);
+    outer.begin(STATE_1);
+    sm.begin(STATE_1);
+    // The event of static engine state must not go to the engine, running the state
+    outer.update();
+    CHECK_EQUAL( false, outer.hasPendingEvents() );
+    sm.update();
+    CHECK_EQUAL( STATE_2, sm.getActiveId() );
+    sm.end();
+    outer.end();
+}
+#endif
+
+TEST(ST, checkTransitionCache)
+{
+    GenericState<sme::NO_ENTER, state1_do_work, sme::NO_EXIT, state1Table> state1(STATE_1);
+    GenericState<sme::NO_ENTER, sme::NO_UPDATE, sme::NO_EXIT, state2Table> state2(STATE_2);
+    GenericState<sme::NO_ENTER, sme::NO_UPDATE, sme::NO_EXIT, state3Table> state3(STATE_3);
+    SmStateInfo statesList[] =
+    {
+        STATE_LIST_ITEM(state1),
+        STATE_LIST_ITEM(state2),
+        STATE_LIST_ITEM(state3),
+        STATE_LIST_END,
+    };
+    GenericStateEngine<masterTable> sm(statesList);
+    sm.setTransitionCache( 16 );
+    sm.begin(STATE_1);
+    for (int i = 0; i < 4; i++)
+    {
+        sm.sendEvent( { EVENT_2, 0 } );
+        sm.update();
+        CHECK_EQUAL( STATE_2, sm.getActiveId() );
+        sm.sendEvent( { EVENT_3, 0 } );
+        sm.update();
+        CHECK_EQUAL( STATE_3, sm.getActiveId() );
+        sm.sendEvent( { EVENT_1, 0 } );
+        sm.update();
+        CHECK_EQUAL( STATE_1, sm.getActiveId() );
+    }
+    CHECK_EQUAL( 3, sm.getTransitionCacheStats().misses );
+    CHECK_EQUAL( 9, sm.getTransitionCacheStats().hits );
+    // Results of not pure states are not cached
+    state1.setPure( false );
+    sm.sendEvent( { EVENT_2, 0 } );
+    sm.update();
+    CHECK_EQUAL( 9, sm.getTransitionCacheStats().hits );
+    sm.end();
+}
+
+static constexpr SmTransitionRow interestRows[] =
+{
+    ROW_SIMPLE(STATE_1, EVENT_1, nullptr, STATE_2),
+    ROW_SIMPLE(STATE_2, EVENT_2, nullptr, STATE_1),
+};
+
+SM_ROW_TABLE_INTEREST(sme::denseTable<interestRows>, interestRows)
+
+TEST(ST, checkEventInterest)
+{
+    GenericState<sme::NO_ENTER, sme::NO_UPDATE, sme::NO_EXIT, sme::NO_TABLE> state1(STATE_1);
+    GenericState<sme::NO_ENTER, sme::NO_UPDATE, sme::NO_EXIT, sme::NO_TABLE> state2(STATE_2);
+    SmStateInfo statesList[] =
+    {
+        STATE_LIST_ITEM(state1),
+        STATE_LIST_ITEM(state2),
+        STATE_LIST_END,
+    };
+    GenericStateEngine<sme::denseTable<interestRows>> sm(statesList);
+    sm.setInterestPolicy( EInterestPolicy::DROP_ON_SEND );
+    sm.begin(STATE_1);
+    CHECK_EQUAL( false, sm.sendEvent( { EVENT_2, 0 } ) );
+    CHECK_EQUAL( 1, sm.getUninterestedEvents() );
+    CHECK_EQUAL( false, sm.hasPendingEvents() );
+    // Dropped events are taken from the array, but not queued
+    SEventData events[] = { { EVENT_2, 0 }, { EVENT_2, 1 } };
+    CHECK_EQUAL( 2, sm.sendEvents( events, 2 ) );
+    CHECK_EQUAL( 3, sm.getUninterestedEvents() );
+    CHECK_EQUAL( false, sm.hasPendingEvents() );
+    sm.sendEvent( { EVENT_1, 0 } );
+    sm.update();
+    CHECK_EQUAL( STATE_2, sm.getActiveId() );
+
+    // The second event becomes irrelevant after the first one is processed
+    sm.setInterestPolicy( EInterestPolicy::DROP_ON_DISPATCH );
+    sm.sendEvent( { EVENT_2, 0 } );
+    sm.sendEvent( { EVENT_2, 0 } );
+    sm.update();
+    CHECK_EQUAL( STATE_1, sm.getActiveId() );
+    CHECK_EQUAL( 4, sm.getUninterestedEvents() );
+
+    sm.setInterestPolicy( EInterestPolicy::KEEP );
+    sm.sendEvent( { EVENT_3, 0 } );
+    sm.update();
+    CHECK_EQUAL( 4, sm.getUninterestedEvents() );
+    sm.end();
+}
+
+#if SM_ENGINE_USE_STL
+class InterestState: public GenericState<sme::NO_ENTER, sme::NO_UPDATE, sme::NO_EXIT, sme::denseTable<interestRows>>
+{
+public:
+    InterestState(): GenericState("interest") { }
+};
+
+TEST(ST, checkAddedStateInterest)
+{
+    SmEngine sm;
+    sm.setEventInterest( &sme::NO_EVENTS );
+    // States get their ids after construction, and the mask is derived from the id
+    sm.addState<InterestState>( STATE_1 );
+    sm.addState<InterestState>( STATE_2 );
+    sm.setInterestPolicy( EInterestPolicy::DROP_ON_SEND );
+    sm.begin(STATE_1);
+    CHECK_EQUAL( false, sm.sendEvent( { EVENT_2, 0 } ) );
+    CHECK_EQUAL( 1, sm.getUninterestedEvents() );
+    CHECK_EQUAL( true, sm.sendEvent( { EVENT_1, 0 } ) );
+    sm.update();
+    CHECK_EQUAL( STATE_2, sm.getActiveId() );
+    CHECK_EQUAL( false, sm.sendEvent( { EVENT_1, 0 } ) );
+    CHECK_EQUAL( 2, sm.getUninterestedEvents() );
+    sm.end();
+}
+#endif